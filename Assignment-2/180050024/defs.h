@@ -125,7 +125,7 @@ int             NumProc(void);
 int             getMaxPid(void);
 int             getProcInfo(int,struct processInfo*);
 int             setprio(int);
-int             getprio();
+int             getprio(int*);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -13,6 +13,29 @@ struct {
   struct proc proc[NPROC];
 } ptable;
 
+// Stride scheduling. A process holds priority tickets and advances
+// its pass by STRIDE1/priority for every timer tick it is running
+// at; the RUNNABLE process with the lowest pass runs next, so each
+// gets a share of the cpu time proportional to its tickets. A process
+// that sleeps before its tick is up is charged nothing.
+//
+// Each cpu keeps its RUNNABLE processes in a min-heap on pass, under
+// its own lock, so picking the next process neither scans the
+// process table nor takes ptable.lock. A process goes back on the
+// queue of the cpu it last ran on; a cpu with an empty queue steals
+// from the longest one. ptable.lock is still held across the switch.
+#define STRIDE1 (1<<16)
+
+struct runq {
+  struct spinlock lock;
+  struct proc *heap[NPROC];
+  int n;
+  uint pass;                   // pass of the last process picked
+} runq[NCPU];
+
+static uint quanta;            // ticks charged since boot, on any
+                               //   cpu; protected by ptable.lock
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -24,7 +47,109 @@ static void wakeup1(void *chan);
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+}
+
+// Whether a should run before b. Passes wrap around, so compare
+// their difference; ties go to the lower slot in the table.
+static int
+passbefore(struct proc *a, struct proc *b)
+{
+  if(a->pass != b->pass)
+    return (int)(a->pass - b->pass) < 0;
+  return a < b;
+}
+
+static void
+siftup(struct runq *q, int i)
+{
+  struct proc *p = q->heap[i];
+
+  for(; i > 0 && passbefore(p, q->heap[(i-1)/2]); i = (i-1)/2)
+    q->heap[i] = q->heap[(i-1)/2];
+  q->heap[i] = p;
+}
+
+static void
+siftdown(struct runq *q, int i)
+{
+  struct proc *p = q->heap[i];
+  int c;
+
+  for(; (c = 2*i + 1) < q->n; i = c){
+    if(c + 1 < q->n && passbefore(q->heap[c+1], q->heap[c]))
+      c++;
+    if(!passbefore(q->heap[c], p))
+      break;
+    q->heap[i] = q->heap[c];
+  }
+  q->heap[i] = p;
+}
+
+// Make p RUNNABLE and put it on its run queue. A new process, or one
+// that has been sleeping, does not get to catch up on the time it
+// missed: its pass is moved up to that of the others.
+// Caller must hold ptable.lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *q = &runq[p->rqcpu];
+
+  acquire(&q->lock);
+  if(p->state == EMBRYO || (int)(p->pass - q->pass) < 0)
+    p->pass = q->pass;
+  p->state = RUNNABLE;
+  q->heap[q->n++] = p;
+  siftup(q, q->n - 1);
+  release(&q->lock);
+}
+
+// Take the process with the lowest pass off q, or return 0.
+// Caller must hold q->lock.
+static struct proc*
+runqget(struct runq *q)
+{
+  struct proc *p;
+
+  if(q->n == 0)
+    return 0;
+  p = q->heap[0];
+  if(--q->n > 0){
+    q->heap[0] = q->heap[q->n];
+    siftdown(q, 0);
+  }
+  q->pass = p->pass;
+  return p;
+}
+
+// Take a process from the longest run queue other than that of
+// cpu self, or return 0 if they are all empty. Passes on different
+// cpus are not comparable, so it starts level with self's.
+static struct proc*
+runqsteal(int self)
+{
+  struct runq *q, *busiest;
+  struct proc *p;
+
+  busiest = 0;
+  for(q = runq; q < &runq[ncpu]; q++)
+    if(q != &runq[self] && q->n > 0 && (busiest == 0 || q->n > busiest->n))
+      busiest = q;
+  if(busiest == 0)
+    return 0;
+  acquire(&busiest->lock);
+  p = runqget(busiest);
+  release(&busiest->lock);
+  if(p){
+    acquire(&runq[self].lock);
+    p->pass = runq[self].pass;
+    release(&runq[self].lock);
+  }
+  return p;
 }
 
 // Must be called with interrupts disabled
@@ -90,6 +215,9 @@ found:
   p->state = EMBRYO;
   p->numswitches=0;
   p->priority=1;
+  p->rqcpu = 0;
+  p->quanta = 0;
+  p->quanta0 = quanta;
   p->pid = nextpid++;
 
   release(&ptable.lock);
@@ -162,7 +290,7 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&ptable.lock);
 }
@@ -228,7 +356,8 @@ fork(void)
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  np->rqcpu = curproc->rqcpu;
+  setrunnable(np);
 
   release(&ptable.lock);
 
@@ -329,86 +458,44 @@ wait(void)
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
+//  - choose the process with the lowest pass from this cpu's run
+//    queue, or steal one from another cpu's
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
 void
 scheduler(void)
 {
-  struct proc *p,*p1;
+  struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *q = &runq[c - cpus];
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    int start=0;
-    int procgcd=0;
-    for(p1 = ptable.proc; p1 < &ptable.proc[NPROC]; p1++){
-      if(p1->state==RUNNABLE && p1->priority>0){
-        procgcd=p1->priority;
-        break;
-      }
-    }
-    release(&ptable.lock);
-    if(procgcd==0){
+    acquire(&q->lock);
+    p = runqget(q);
+    release(&q->lock);
+    if(p == 0 && (p = runqsteal(c - cpus)) == 0)
       continue;
-    }
+
+    // Switch to chosen process.  It is the process's job
+    // to release ptable.lock and then reacquire it
+    // before jumping back to us.
     acquire(&ptable.lock);
-    for(p1 = ptable.proc; p1 < &ptable.proc[NPROC]; p1++){
-      if(p1->state==RUNNABLE){
-        int a=p1->priority;
-        while(a!=procgcd){
-          if(a>procgcd)
-            a-=procgcd;
-          else
-            procgcd-=a;
-        }
-      }
-      if(p1->state==RUNNABLE && start < p1->priority){
-        start=p1->priority;
-      }
-    }
+    c->proc = p;
+    p->rqcpu = c - cpus;
+    switchuvm(p);
+    p->state = RUNNING;
+    swtch(&(c->scheduler), p->context);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
     release(&ptable.lock);
-    while(start>0){
-      acquire(&ptable.lock);
-      for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-        if(p->state != RUNNABLE){
-          continue;
-        }
-        if(p->priority<start){
-          continue;
-        }
-
-        // Switch to chosen process.  It is the process's job
-        // to release ptable.lock and then reacquire it
-        // before jumping back to us.
-        c->proc = p;
-        switchuvm(p);
-        p->state = RUNNING;
-        swtch(&(c->scheduler), p->context);
-        switchkvm();
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&ptable.lock);
-      if(procgcd>0 && start>=procgcd){
-        start=start-procgcd;
-      }
-      else{
-        start=start-1;
-      }
-      
-    }
-
-    //release(&ptable.lock);
-
   }
 }
 
@@ -445,8 +532,15 @@ sched(void)
 void
 yield(void)
 {
+  struct proc *p = myproc();
+
   acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  // Only the timer interrupt yields (see trap()), so p has been
+  // running at this tick: charge it.
+  p->pass += STRIDE1 / p->priority;
+  p->quanta++;
+  quanta++;
+  setrunnable(p);
   sched();
   release(&ptable.lock);
 }
@@ -521,7 +615,7 @@ wakeup1(void *chan)
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+      setrunnable(p);
 }
 
 // Wake up all processes sleeping on chan.
@@ -547,7 +641,7 @@ kill(int pid)
       p->killed = 1;
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+        setrunnable(p);
       release(&ptable.lock);
       return 0;
     }
@@ -653,20 +747,38 @@ getProcInfo(int pid,struct processInfo* p1)
   return ach;
 }
 
+// Set the number of tickets of the current process.
 int
 setprio(int n)
 {
   struct proc *curproc = myproc();
-  if(n<1){
+  if(n<1 || n>STRIDE1){
     return -1;
   }
+  acquire(&ptable.lock);
   curproc->priority=n;
+  release(&ptable.lock);
   return 0;
 }
 
+// Return the number of tickets of the current process. If share is
+// not 0, also store there its share, in thousandths, of the timer
+// ticks charged on all cpus since it was created.
 int
-getprio(void)
+getprio(int *share)
 {
   struct proc *curproc = myproc();
+  uint mine, all;
+
+  if(share){
+    acquire(&ptable.lock);
+    mine = curproc->quanta;
+    all = quanta - curproc->quanta0;
+    release(&ptable.lock);
+    // Keep mine*1000 from overflowing.
+    for(; all > 1000000; all >>= 1)
+      mine >>= 1;
+    *share = all ? mine * 1000 / all : 0;
+  }
   return curproc->priority;
 }
\ No newline at end of file
@@ -50,7 +50,11 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   int numswitches;
-  int priority;
+  int priority;                // Tickets for the stride scheduler
+  uint pass;                   // Stride scheduler virtual time
+  uint quanta;                 // Timer ticks it has been running at
+  uint quanta0;                // Ticks charged before it was created
+  int rqcpu;                   // cpu whose run queue the process goes on
 };
 
 // Process memory is laid out contiguously, low addresses first:
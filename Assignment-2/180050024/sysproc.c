@@ -144,5 +144,14 @@ sys_setprio(void)
 int
 sys_getprio(void)
 {
-  return getprio();
+  int addr;
+  int *share = 0;
+
+  // The share pointer is optional: 0 means the caller only wants
+  // the tickets.
+  if(argint(0, &addr) < 0)
+    return -1;
+  if(addr != 0 && argptr(0, (void*)&share, sizeof(*share)) < 0)
+    return -1;
+  return getprio(share);
 }
\ No newline at end of file
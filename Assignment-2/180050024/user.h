@@ -30,7 +30,7 @@ int getNumProc(void);
 int getMaxPid(void);
 int getProcInfo(int,struct processInfo*);
 int setprio(int);
-int getprio(void);
+int getprio(int*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -21,6 +21,7 @@ int main(int argc, char* argv[])
 	else {
 		// printing the information for the required process.
 		printf(1, "Process ID: %d\nProcess Size: %d\nNumber of Context Switches: %d\n", p->ppid, p->psize, p->numberContextSwitches);	
+		printf(1, "Burst Time: %d\nPredicted Burst Time: %d\n", p->burstTime, p->predBurst);
 	}
 	exit();
 }
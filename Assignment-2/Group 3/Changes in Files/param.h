@@ -14,4 +14,7 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#ifndef BURSTALPHA
+#define BURSTALPHA   50  // weight (%) of the last cpu burst in predBurst
+#endif
 
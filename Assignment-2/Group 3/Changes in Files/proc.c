@@ -13,6 +13,26 @@ struct {
   struct proc proc[NPROC];
 } ptable;
 
+// Each cpu has a queue of RUNNABLE processes, so that picking the
+// next process neither scans the whole process table nor takes
+// ptable.lock. A process goes back on the queue of the cpu it last
+// ran on; a cpu with an empty queue steals from the longest one.
+// ptable.lock is still held across the switch itself, as before.
+//
+// With SJF and HBSJF the queue is a binary min-heap ordered by
+// runsbefore(), so both adding and picking a process take O(log n).
+struct runq {
+  struct spinlock lock;
+  int n;
+  int round;                   // current HBSJF round
+#if defined(SJF) || defined(HBSJF)
+  struct proc *heap[NPROC];
+#else
+  struct proc *head;           // oldest first
+  struct proc *tail;
+#endif
+} runq[NCPU];
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -25,7 +45,155 @@ static void wakeup1(void *chan);
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NCPU; i++){
+    initlock(&runq[i].lock, "runq");
+    runq[i].round = 1;
+  }
+}
+
+// p has stopped running, either to sleep or to yield: fold its last
+// cpu burst into the exponential average
+//   pred = alpha * burst + (1 - alpha) * pred
+// with alpha = BURSTALPHA percent, rounded to the nearest tick.
+// Caller must hold ptable.lock.
+static void
+endburst(struct proc *p)
+{
+  p->predBurst = (BURSTALPHA * p->cpuBurst +
+                  (100 - BURSTALPHA) * p->predBurst + 50) / 100;
+  p->cpuBurst = 0;
+}
+
+#if defined(SJF) || defined(HBSJF)
+// The burst time a process is scheduled by: the one it declared
+// with set_burst_time(), or else the one predicted from its past.
+static int
+burst(struct proc *p)
+{
+  return p->burstTime ? p->burstTime : p->predBurst;
+}
+
+// Whether a should run before b: in HBSJF those not yet run in this
+// round come first, then the lower burst time, then the lower slot
+// in the process table.
+static int
+runsbefore(struct proc *a, struct proc *b)
+{
+  #ifdef HBSJF
+  if(a->rqround != b->rqround)
+    return a->rqround < b->rqround;
+  #endif
+  if(burst(a) != burst(b))
+    return burst(a) < burst(b);
+  return a < b;
+}
+
+static void
+siftup(struct runq *q, int i)
+{
+  struct proc *p = q->heap[i];
+
+  for(; i > 0 && runsbefore(p, q->heap[(i-1)/2]); i = (i-1)/2)
+    q->heap[i] = q->heap[(i-1)/2];
+  q->heap[i] = p;
+}
+
+static void
+siftdown(struct runq *q, int i)
+{
+  struct proc *p = q->heap[i];
+  int c;
+
+  for(; (c = 2*i + 1) < q->n; i = c){
+    if(c + 1 < q->n && runsbefore(q->heap[c+1], q->heap[c]))
+      c++;
+    if(!runsbefore(q->heap[c], p))
+      break;
+    q->heap[i] = q->heap[c];
+  }
+  q->heap[i] = p;
+}
+#endif
+
+// Put p, which has just become RUNNABLE, on its run queue.
+// Caller must hold ptable.lock.
+static void
+runqput(struct proc *p)
+{
+  struct runq *q = &runq[p->rqcpu];
+
+  acquire(&q->lock);
+#if defined(SJF) || defined(HBSJF)
+  /*
+    HBSJF: in each round run the lowest burst time process that has
+    not run in the current round. Once all of them have, start the
+    next round, which makes every process eligible again. A process
+    that already ran in this round waits for the next one.
+  */
+  p->rqround = p->alreadyRun >= q->round ? q->round + 1 : q->round;
+  q->heap[q->n++] = p;
+  siftup(q, q->n - 1);
+#else
+  p->rqnext = 0;
+  if(q->tail)
+    q->tail->rqnext = p;
+  else
+    q->head = p;
+  q->tail = p;
+  q->n++;
+#endif
+  release(&q->lock);
+}
+
+// Take the process that should run next off q, or return 0.
+// Caller must hold q->lock.
+static struct proc*
+runqget(struct runq *q)
+{
+  struct proc *p;
+
+  if(q->n == 0)
+    return 0;
+#if defined(SJF) || defined(HBSJF)
+  p = q->heap[0];
+  if(p->rqround > q->round){
+    // Everyone on this queue has run in this round: next round.
+    q->round++;
+  }
+  if(--q->n > 0){
+    q->heap[0] = q->heap[q->n];
+    siftdown(q, 0);
+  }
+#else
+  p = q->head;
+  if((q->head = p->rqnext) == 0)
+    q->tail = 0;
+  q->n--;
+#endif
+  return p;
+}
+
+// Take a process from the longest run queue other than that of
+// cpu self, or return 0 if they are all empty.
+static struct proc*
+runqsteal(int self)
+{
+  struct runq *q, *busiest;
+  struct proc *p;
+
+  busiest = 0;
+  for(q = runq; q < &runq[ncpu]; q++)
+    if(q != &runq[self] && q->n > 0 && (busiest == 0 || q->n > busiest->n))
+      busiest = q;
+  if(busiest == 0)
+    return 0;
+  acquire(&busiest->lock);
+  p = runqget(busiest);
+  release(&busiest->lock);
+  return p;
 }
 
 // Must be called with interrupts disabled
@@ -93,8 +261,10 @@ found:
 
   p->burstTime = 0;     // default value for burst time
   p->numOfSwitches = 0; // initial number of context switches = 0
-  p->alreadyRun = 0;    // since it was unused, it didn't ran previously 
+  p->alreadyRun = 0;    // since it was unused, it didn't run in any round
   p->runningTime = 0; 	// time for which it has runned = 0
+  p->cpuBurst = 0;
+  p->predBurst = 0;
 
   release(&ptable.lock);
 
@@ -156,6 +326,8 @@ userinit(void)
   acquire(&ptable.lock);
 
   p->state = RUNNABLE;
+  p->rqcpu = 0;
+  runqput(p);
 
   release(&ptable.lock);
 }
@@ -204,6 +376,7 @@ fork(void)
     return -1;
   }
   np->sz = curproc->sz;
+  np->predBurst = curproc->predBurst;  // best guess until it has run
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -222,6 +395,8 @@ fork(void)
   acquire(&ptable.lock);
 
   np->state = RUNNABLE;
+  np->rqcpu = curproc->rqcpu;
+  runqput(np);
 
   release(&ptable.lock);
 
@@ -322,109 +497,47 @@ wait(void)
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
+//  - choose a process to run from this cpu's run queue, or
+//    steal one from another cpu's
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
+// With SJF or HBSJF the queue is ordered by burst time; see runsbefore().
 void
 scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *q = &runq[c - cpus];
   c->proc = 0;
   
   for(;;)
   {  
     // Enable interrupts on this processor.
     sti();
-  
-    // Loop over process table looking for process to run.
+
+    acquire(&q->lock);
+    p = runqget(q);
+    release(&q->lock);
+    if(p == 0 && (p = runqsteal(c - cpus)) == 0)
+      continue;
+
+    // Switch to chosen process.  It is the process's job
+    // to release ptable.lock and then reacquire it
+    // before jumping back to us.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    {  
-      if(p->state != RUNNABLE)
-        continue;
-      
-      // if doing shortest job first scheduling
-      #ifdef SJF 
-      
-      struct proc *lowestBT = p; //stores the lowest burst time
-      struct proc *p1 = 0; //act as loop variable
-      for(p1 = ptable.proc; p1 < &ptable.proc[NPROC]; p1++){
-    		if(p1->state == RUNNABLE && p1->burstTime < lowestBT->burstTime)
-    			lowestBT = p1;
-    	}
-      p = lowestBT;
-      
-      // if doing Hybrid scheduling
-      #else 
-      #ifdef HBSJF
-      /*
-      	Algorithm: In each round find the lowest burst time process which is not being run in the current round. Run this process. 
-    		If all processes are run one time in a round then we start with next round. Again choosing the minimum burst time process.	  		 
-      		
-      	Extra variables which we need to maintain are: 
-      	One variable "alreadyRun" to indicate whether the process has been run in current round or not.
-		    alreadyRun = 0 means process has not been executed in this round.
-			      			
-      	pseudo code: 
-      	1) Find the minimum burst time process by running a for loop.
-      	2) Find a process which has least burst time && it has not been run in this round
-      	3) If no such process is found in round 2), start next round with process found in 1)	
-      */
-      
-      struct proc *lowestBT = p;    // stores the lowest burst time
-      struct proc *p1 = 0;          // act as loop variable
-      int flag = 0;
-      struct proc* remLowest = 0;
-      	
-      for(p1 = ptable.proc; p1 < &ptable.proc[NPROC]; p1++){
-    		if(p1->state == RUNNABLE && p1->burstTime < lowestBT->burstTime)
-    			lowestBT = p1;
-    	}
-    	
-    	//Finding a job which has not been run yet in this round andd having minimum burst time
-    	for(p1 = ptable.proc; p1 < &ptable.proc[NPROC]; p1++){
-    		if(p1->state == RUNNABLE && p1->alreadyRun == 0){
-    			if(flag == 0){
-    				flag = 1;
-    				remLowest = p1;
-    			}
-    			else if(p1->burstTime < remLowest->burstTime){
-    				remLowest = p1;
-    			}	
-    		}
-    	}
-    	
-    	if(flag == 0){ //start with next round
-    		p = lowestBT;
-    		
-        //Now in new round all process will have variable alreadyRun = 0;
-    		for(p1 = ptable.proc; p1 < &ptable.proc[NPROC]; p1++)
-    			p1->alreadyRun = 0;	
-    	}
-    	else {
-    		p = remLowest;
-    	}
-    	
-      #endif
-      #endif	
-      
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-	    p->numOfSwitches = p->numOfSwitches + 1;
-      switchuvm(p);
-      p->state = RUNNING;
-	    p->alreadyRun = 1;	
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
-    }
+    c->proc = p;
+    p->rqcpu = c - cpus;
+    p->numOfSwitches = p->numOfSwitches + 1;
+    switchuvm(p);
+    p->state = RUNNING;
+    p->alreadyRun = q->round;
+    swtch(&(c->scheduler), p->context);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
     release(&ptable.lock);
   }
 }
@@ -462,6 +575,8 @@ yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
   myproc()->state = RUNNABLE;
+  endburst(myproc());
+  runqput(myproc());
   sched();
   release(&ptable.lock);
 }
@@ -513,6 +628,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  endburst(p);
 
   sched();
 
@@ -535,8 +651,10 @@ wakeup1(void *chan)
   struct proc *p;
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
+    if(p->state == SLEEPING && p->chan == chan){
       p->state = RUNNABLE;
+      runqput(p);
+    }
 }
 
 // Wake up all processes sleeping on chan.
@@ -561,8 +679,10 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
+      if(p->state == SLEEPING){
         p->state = RUNNABLE;
+        runqput(p);
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -628,7 +748,7 @@ set_burst_time(int n)
 	
 	if(n < TimeQuanta) TimeQuanta = n; // Setting TimeQuanta equals to minimum burst time set.
 	
-	yield(); // this is required to put the current process in ready queue 
+	yield(); // this is required to put the current process in ready queue, at its new place
 	
   // returning 0 as burstTime is setted successfully to n.
 	return 0; 
@@ -728,6 +848,10 @@ getProcInfo(int pid, struct processInfo* ptr)
 
       // setting the number of context switches of the process
       ptr->numberContextSwitches = p->numOfSwitches;
+
+      // setting the declared and the predicted burst times
+      ptr->burstTime = p->burstTime;
+      ptr->predBurst = p->predBurst;
       break;
     }
   }  
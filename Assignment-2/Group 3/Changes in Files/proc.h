@@ -52,9 +52,14 @@ struct proc {
 
   int numOfSwitches; 		       // to count number of switches
   int burstTime;			         // burst time for Process in seconds		
-  int alreadyRun;              // to check if the process has runned already for some time or not
+  int alreadyRun;              // HBSJF round in which the process last ran (see runq)
   int runningTime;             // to store for how much time the process has ran already
-  
+  int cpuBurst;                // ticks run since it last slept or yielded
+  int predBurst;               // predicted cpu burst in ticks, see endburst()
+
+  struct proc *rqnext;         // next process in the same run queue
+  int rqround;                 // HBSJF round it is queued to run in
+  int rqcpu;                   // cpu whose run queue the process goes on
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -3,5 +3,7 @@ struct processInfo
     int ppid;
     int psize;
     int numberContextSwitches;
+    int burstTime;              // set by set_burst_time(), 0 if never set
+    int predBurst;              // measured by the kernel, in ticks
 };
 
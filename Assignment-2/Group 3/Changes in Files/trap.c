@@ -103,6 +103,11 @@ trap(struct trapframe *tf)
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
   
+  // Charge the tick to the running process's current cpu burst.
+  if(myproc() && myproc()->state == RUNNING &&
+     tf->trapno == T_IRQ0+IRQ_TIMER)
+    myproc()->cpuBurst++;
+
   #ifdef SJF
   //no context switch
   #else
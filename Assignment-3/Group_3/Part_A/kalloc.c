@@ -1,6 +1,10 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Idle cpus also keep a pool of pages that are already zeroed (see
+// kzero_refill()), so kalloc_zeroed() on the page fault path usually
+// does not have to clear a page itself.
 
 #include "types.h"
 #include "defs.h"
@@ -21,8 +25,16 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  int nfree;                   // pages on freelist
 } kmem;
 
+// Free pages that have already been zeroed.
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;
+} zpool;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -32,6 +44,7 @@ void
 kinit1(void *vstart, void *vend)
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&zpool.lock, "zpool");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -64,18 +77,41 @@ kfree(char *v)
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
 
+// Take a page off zpool, clearing the link word that was
+// stored in it. Returns 0 if the pool is empty.
+static char*
+zpool_get(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock)
+    return 0;   // too early for locks; the pool is empty anyway
+  acquire(&zpool.lock);
+  if((r = zpool.list) != 0){
+    zpool.list = r->next;
+    zpool.n--;
+  }
+  release(&zpool.lock);
+  if(r)
+    r->next = 0;
+  return (char*)r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -87,10 +123,51 @@ kalloc(void)
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(r == 0)
+    r = (struct run*)zpool_get();
   return (char*)r;
 }
 
+// Allocate one page of physical memory filled with zeros,
+// preferring a page zeroed earlier by an idle cpu.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_zeroed(void)
+{
+  char *v;
+
+  if((v = zpool_get()) != 0)
+    return v;
+  if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// Called by scheduler() when a pass found nothing to run.
+// Zero a few free pages and park them on zpool, unless memory is
+// short enough that they would be better left alone.
+void
+kzero_refill(void)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < ZBATCH && zpool.n < NZPOOL; i++){
+    if(kmem.nfree < 2*NZPOOL)
+      break;
+    if((r = (struct run*)kalloc()) == 0)
+      break;
+    memset(r, 0, PGSIZE);
+    acquire(&zpool.lock);
+    r->next = zpool.list;
+    zpool.list = r;
+    zpool.n++;
+    release(&zpool.lock);
+  }
+}
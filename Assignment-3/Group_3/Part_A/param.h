@@ -11,4 +11,7 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define NZPOOL       64  // pre-zeroed pages kept ready for kalloc_zeroed
+#define ZBATCH        8  // pages zeroed per idle scheduler pass
+#define FAULTAROUND  16  // most heap pages mapped by one sequential page fault
 
@@ -88,7 +88,8 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
-  p->oldsz = 0;
+  p->faultnext = 0;
+  p->faultwin = 1;
 
   release(&ptable.lock);
 
@@ -325,6 +326,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -332,10 +334,12 @@ scheduler(void)
     sti();
 
     // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -353,6 +357,10 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Nothing to run: use the idle time to zero pages ahead of
+    // the page faults that will want them.
+    if(!ran)
+      kzero_refill();
   }
 }
 
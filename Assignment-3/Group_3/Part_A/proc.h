@@ -49,7 +49,8 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  uint oldsz;                  // size before allocation in lazy allocation
+  uint faultnext;              // heap page fault address that would be sequential
+  int faultwin;                // pages the next sequential heap fault maps
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -51,7 +51,12 @@ sys_sbrk(void)
   if(argint(0, &n) < 0)
     return -1;
   addr = myproc()->sz;
-  if(growproc(n) < 0)
+  // Growth is lazy: trap() maps the new pages when they are touched.
+  if(n > 0){
+    if(addr + n < addr || addr + n > KERNBASE)
+      return -1;
+    myproc()->sz += n;
+  } else if(growproc(n) < 0)
     return -1;
   return addr;
 }
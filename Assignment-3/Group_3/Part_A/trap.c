@@ -14,8 +14,6 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
  
-extern int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
- 
 void
 tvinit(void)
 {
@@ -80,6 +78,15 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
  
+  case T_PGFLT:
+    // A heap page that sbrk() handed out but nobody has touched yet.
+    // System calls map the user memory they use first (lazyfill()),
+    // so a fault from the kernel that finds no memory is a bug.
+    if(myproc() && rcr2() < myproc()->sz &&
+       lazyfault(myproc(), rcr2()) == 0)
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -88,32 +95,9 @@ trap(struct trapframe *tf)
               tf->trapno, cpuid(), tf->eip, rcr2());
       panic("trap");
     }
-    if(rcr2() > myproc()->sz){
+    if(tf->trapno == T_PGFLT && rcr2() >= myproc()->sz)
         cprintf("Unhandled Page Fault \n");
-    }
-    else {   
-        if(tf->trapno == T_PGFLT)
-        {
-            char *mem;
-            uint a;
-            if(myproc()->sz < myproc()->oldsz){
-                return;
-            }
-            
-            a = PGROUNDDOWN(rcr2());
-            mem = kalloc();
-            if(mem == 0){
-                cprintf("allocuvm out of memory \n");
-                myproc()->killed = 1;
-                return;
-            }
-            
-            memset(mem, 0, PGSIZE);
-            mappages(myproc()->pgdir, (char*) a, PGSIZE, V2P(mem), PTE_W|PTE_U);
-            break; 
-        }
-    }
-    
+
     // In user space, assume process misbehaved.
     cprintf("pid %d %s: trap %d err %d on cpu %d "
             "eip 0x%x addr 0x%x--kill proc\n",
@@ -42,10 +42,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    // kalloc_zeroed() makes sure all those PTE_P bits are zero.
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
       return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -121,9 +120,8 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
@@ -186,8 +184,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
@@ -231,13 +228,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -323,10 +319,9 @@ copyuvm(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+    // Heap pages not touched yet stay unmapped in the child too.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || !(*pte & PTE_P))
+      continue;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
     if((mem = kalloc()) == 0)
@@ -344,6 +339,74 @@ bad:
   return 0;
 }
 
+// Map zeroed pages for the lazily grown heap of p, from the page
+// containing va on. A fault just past the pages mapped by the last
+// one doubles the window, up to FAULTAROUND pages, so a linear fill
+// of a large buffer traps only once every FAULTAROUND pages; any
+// other fault maps one page. Returns -1 if va is already mapped or
+// no memory is left.
+int
+lazyfault(struct proc *p, uint va)
+{
+  uint a;
+  pte_t *pte;
+  char *mem;
+  int n;
+
+  a = PGROUNDDOWN(va);
+  if(a == p->faultnext){
+    if(p->faultwin < FAULTAROUND)
+      p->faultwin *= 2;
+  } else
+    p->faultwin = 1;
+
+  for(n = 0; n < p->faultwin && a + n*PGSIZE < p->sz; n++){
+    if((pte = walkpgdir(p->pgdir, (char*)a + n*PGSIZE, 1)) == 0 ||
+       (*pte & PTE_P))
+      break;
+    if((mem = kalloc_zeroed()) == 0)
+      break;
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+  }
+  if(n == 0)
+    return -1;
+  p->faultnext = a + n*PGSIZE;
+  return 0;
+}
+
+// Map the heap pages of p in [va, va+n) that sbrk() has handed out
+// but nobody has touched yet, so that a system call can use them
+// without faulting in the kernel, where running out of memory could
+// not be survived. If memory runs out, kill p and return -1.
+int
+lazyfill(struct proc *p, uint va, uint n)
+{
+  uint a, last;
+  pte_t *pte;
+  char *mem;
+
+  if(n == 0)
+    return 0;
+  last = PGROUNDDOWN(va + n - 1);
+  for(a = PGROUNDDOWN(va); ; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 1)) == 0)
+      goto bad;
+    if((*pte & PTE_P) == 0){
+      if((mem = kalloc_zeroed()) == 0)
+        goto bad;
+      *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+    }
+    if(a == last)
+      break;
+  }
+  return 0;
+
+bad:
+  cprintf("pid %d %s: out of memory--kill proc\n", p->pid, p->name);
+  p->killed = 1;
+  return -1;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -10,6 +10,21 @@ struct buf {
   uchar data[BSIZE];
 };
 
+// A transfer of whole pages to or from consecutive disk blocks
+// that bypasses the buffer cache; used for swap. See idepages().
+struct pagereq {
+  int write;                   // 1 to write the pages, 0 to read them
+  uint dev;
+  uint blockno;                // first block
+  int npages;
+  char *pages[SWAPBATCH];
+  int sent;                    // sectors moved so far
+  int complete;
+  int error;                   // set if the disk failed the transfer
+  void (*done)(struct pagereq*);  // if set, called by ideintr() at the end
+  struct pagereq *qnext;       // disk queue
+};
+
 //*** change ****
 #define B_BUSY  0x1  // buffer is locked by some process
 #define B_VALID 0x2  // buffer has been read from disk
@@ -2,7 +2,13 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
+struct pagereq;
+struct processInfo;
+struct vmstat;
 struct pipe;
+struct vma;
+struct shm;
 struct proc;
 struct rtcdate;
 struct spinlock;
@@ -60,6 +66,7 @@ int				removeSwapFile(struct proc* p);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            idepages(struct pagereq*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -68,7 +75,23 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_order(int);
+char*           kalloc_zeroed(void);
+void            kzero_refill(void);
 void            kfree(char*);
+void            kfree_order(char*, int);
+void            kdup(char*);
+int             krefcount(char*);
+void            krmap(char*, pde_t*, uint);
+void            kswapcache(char*, int);
+int             kswapuncache(char*);
+void            kmarkpgdir(char*);
+void            kunmarkpgdir(char*);
+int             kpgdirlive(pde_t*);
+int             kpgdirpin(pde_t*, int);
+void            kpgdirover(char*, int);
+int             kpgdirisover(pde_t*);
+int             krmapget(uint, pde_t**, uint*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -101,7 +124,19 @@ void            mpstartthem(void);
 void            picenable(int);
 void            picinit(void);
 
+// mmap.c
+void            shminit(void);
+struct vma*     findvma(struct proc*, uint);
+struct vma*     vmarange(struct proc*, uint, uint, int);
+int             mmap(uint, uint, int, int, struct file*, uint);
+int             mmap_fault(struct vma*, uint);
+int             munmap(uint, uint);
+void            munmapall(struct proc*);
+int             mmap_fork(struct proc*, struct proc*);
+void            mmap_filewrite(struct inode*, uint, char*, uint);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -125,9 +160,37 @@ void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+struct proc*    create_kernel_process(const char*, void (*)());
+void            kswapdinit(void);
+void            kswapd_wake(void);
+int             pgdir_pin(pde_t*);
+void            pgdir_unpin(pde_t*);
+void            pgdir_drain(pde_t*);
+int             getProcInfo(int, struct processInfo*);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
+int             timeslice(void);
+
+// swap.c
+void            swapinit(int);
+int             swap_alloc(void);
+void            swap_dup(uint);
+void            swap_free(uint);
+void            swap_write(uint, char*);
+int             swap_read(uint, char*);
+int             swap_read_pages(uint, char**, int);
+void            swap_flush(int);
+int             swap_inflight(void);
+int             swap_cacheable(void);
+
+int             swap_avail(void);
+
+// zswap.c
+void            zswapinit(void);
+int             zswap_store(uint, char*);
+int             zswap_load(uint, char*);
+void            zswap_invalidate(uint);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -136,6 +199,19 @@ void            swtch(struct context**, struct context*);
 struct inode*	create(char *path, short type, short major, short minor);
 int				isdirempty(struct inode *dp);
 
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
+// textcache.c
+void            textcacheinit(void);
+char*           textcache_get(struct inode*, uint);
+void            textcache_put(struct inode*, uint, char*);
+void            textcache_inval(struct inode*, uint, uint);
+int             textcache_reclaim(void);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -166,6 +242,7 @@ int             strcmp(const char *, const char *);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argrdptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -185,6 +262,11 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// pgstat.c
+void            vmstat_add(int, int);
+void            vmstat_fault(int, uint64);
+int             getvmstat(struct vmstat*, int);
+
 // vm.c
 void 			checkProcAccBit();
 void            seginit(void);
@@ -202,6 +284,8 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             cowfault(pde_t*, uint);
+int             wsample(pde_t*, int*, int*);
 void            swapPages(uint);
 
 // number of elements in fixed-size array
@@ -7,6 +7,21 @@
 #include "x86.h"
 #include "elf.h"
 
+// Release the program inodes held by seg[].
+// Must be called inside a transaction.
+static void
+segput(struct segment *seg)
+{
+  int i;
+
+  for(i = 0; i < NSEG; i++){
+    if(seg[i].ip){
+      iput(seg[i].ip);
+      seg[i].ip = 0;
+    }
+  }
+}
+
 int
 exec(char *path, char **argv)
 {
@@ -16,6 +31,7 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct segment seg[NSEG], *sp0;
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
@@ -28,6 +44,8 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  memset(seg, 0, sizeof(seg));
+  sp0 = seg;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,7 +56,8 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record where the program lives in the file. Nothing is read
+  // yet: map_address() loads each page on its first fault.
   sz = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
@@ -49,12 +68,22 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz >= KERNBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.off + ph.filesz < ph.off)
       goto bad;
+    if(sp0 == &seg[NSEG])
+      goto bad;
+    sp0->ip = idup(ip);
+    sp0->va = ph.vaddr;
+    sp0->off = ph.off;
+    sp0->filesz = ph.filesz;
+    sp0->memsz = ph.memsz;
+    sp0++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
@@ -94,13 +123,22 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
+  munmapall(curproc);
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
+  for(i = 0; i < NSEG; i++){
+    struct segment t = curproc->seg[i];
+    curproc->seg[i] = seg[i];
+    seg[i] = t;
+  }
   switchuvm(curproc);
   freevm(oldpgdir);
+  begin_op();
+  segput(seg);
+  end_op();
   return 0;
 
  bad:
@@ -108,6 +146,11 @@ exec(char *path, char **argv)
     freevm(pgdir);
   if(ip){
     iunlockput(ip);
+    segput(seg);
+    end_op();
+  } else {
+    begin_op();
+    segput(seg);
     end_op();
   }
   return -1;
@@ -0,0 +1,55 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Time fork+exit+wait for processes of growing size.
+// usage: forkbench [maxkb [iterations]]
+// Build the kernel with NOCOW=1 to compare against eager copying.
+//
+// Sizes double from 64 KB up to maxkb, 1 MB by default. Parents of
+// 1-64 MB do not fit: PHYSTOP limits this kernel to 4 MB of memory,
+// and an eager copy of a 1 MB parent already needs 2 MB of it.
+
+#define PGSIZE 4096
+
+int
+main(int argc, char *argv[])
+{
+	int maxkb = 1024, iters = 20;
+	int kb, i, pid, t0, t1;
+	char *base, *p;
+	uint have = 0;
+
+	if (argc > 1)
+		maxkb = atoi(argv[1]);
+	if (argc > 2)
+		iters = atoi(argv[2]);
+
+	base = sbrk(0);
+	printf(1, "forkbench: %d forks per size\n", iters);
+	for (kb = 64; kb <= maxkb; kb *= 2) {
+		// Grow the heap and touch every page so fork has to deal with it.
+		if (sbrk(kb * 1024 - have) == (char*)-1) {
+			printf(1, "forkbench: sbrk failed at %d KB\n", kb);
+			break;
+		}
+		for (p = base + have; p < base + kb * 1024; p += PGSIZE)
+			*p = 1;
+		have = kb * 1024;
+
+		t0 = uptime();
+		for (i = 0; i < iters; i++) {
+			pid = fork();
+			if (pid < 0) {
+				printf(1, "forkbench: fork failed\n");
+				exit();
+			}
+			if (pid == 0)
+				exit();
+			wait();
+		}
+		t1 = uptime();
+		printf(1, "%d KB: %d ticks for %d forks\n", kb, t1 - t0, iters);
+	}
+	exit();
+}
@@ -15,7 +15,6 @@ static void itrunc(struct inode*);
 static void bfree(int dev, uint b);
 
 struct superblock sb;
-int numallocblocks = 0;
 
 // Read the super block.
 void 
@@ -64,38 +63,6 @@ balloc(uint dev)
   panic("balloc: out of blocks");
 }
 
-uint
-balloc_page(uint dev)
-{
-  uint allocatedBlocks[100000];
-  int indexNCB = -1;                        // pointer for above array, keeps track till where it is filled
-  for(int i = 0;i < 8; i++)
-  {
-      indexNCB++;
-      allocatedBlocks[indexNCB] = balloc(dev);
-      if(i > 0){
-          if((allocatedBlocks[indexNCB]-allocatedBlocks[indexNCB-1])!=1) {
-              i = 0;                        // start allocating blocks again
-          }
-      }
-    }
-    for(int i = 0;i <= indexNCB-8; i++){
-      bfree(ROOTDEV,allocatedBlocks[i]);    // free unnecesarily allocated blocks
-    }
-    numallocblocks += 1;      
-	  return allocatedBlocks[indexNCB-7];    // return last 8 blocks (address of 1st block among them)
-}
-
-// Free disk blocks allocated using balloc_page.
-void
-bfree_page(int dev, uint b)
-{ 
-  for(uint i = 0;i < 8; i++){
-    bfree(ROOTDEV,b+i);
-  }
-  numallocblocks -= 1;      
-}
-
 // Free a disk block
 static void
 bfree(int dev, uint b)
@@ -318,6 +285,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  textcache_inval(ip, 0, ip->size);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -394,10 +362,12 @@ writei(struct inode *ip, char *src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  textcache_inval(ip, off, n);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
+    mmap_filewrite(ip, off, (char*)bp->data + off%BSIZE, m);
     log_write(bp);
     brelse(bp);
   }
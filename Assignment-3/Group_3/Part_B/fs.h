@@ -19,6 +19,8 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint swapstart;    // Block number of the swap area, after the file system
+  uint nswap;        // Number of page-sized slots in the swap area
 };
 
 #define NDIRECT 12
@@ -56,7 +58,3 @@ struct dirent {
 };
 
 
-uint balloc_page(uint dev);
-void bfree_page(int dev, uint b);
-void write_page_to_disk(uint dev, char *pg, uint blk);
-void read_page_from_disk(uint dev, char *pg, uint blk);
@@ -17,12 +17,17 @@
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
 #define IDE_DF        0x20
+#define IDE_DRQ       0x08
 #define IDE_ERR       0x01
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_SETMUL 0xc6
+
+#define MULTSECT      16    // sectors per interrupt for RDMUL/WRMUL
+#define SECT_PER_PAGE (PGSIZE/SECTOR_SIZE)
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
@@ -31,8 +36,15 @@
 static struct spinlock idelock;
 static struct buf *idequeue;
 
+// pagequeue holds page transfers (swap). Its head owns the disk
+// while pageactive is set; otherwise the head of idequeue does.
+// Buffer cache requests go first whenever the disk frees up.
+static struct pagereq *pagequeue;
+static int pageactive;
+
 static int havedisk1;
 static void idestart(struct buf*);
+static void idekick(void);
 
 // Wait for IDE disk to become ready.
 static int
@@ -65,6 +77,17 @@ ideinit(void)
     }
   }
 
+  // Let RDMUL/WRMUL move MULTSECT sectors per interrupt. This is a
+  // setting of the selected drive; swap is on disk 1 (ROOTDEV).
+  if(havedisk1){
+    outb(0x1f6, 0xe0 | (1<<4));
+    idewait(0);
+    outb(0x1f2, MULTSECT);
+    outb(0x1f7, IDE_CMD_SETMUL);
+    if(idewait(1) < 0)
+      panic("ideinit: setmul");
+  }
+
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
@@ -99,15 +122,125 @@ idestart(struct buf *b)
   }
 }
 
+// Move the next block of up to MULTSECT sectors of r between
+// memory and the disk.
+static void
+pagexfer(struct pagereq *r)
+{
+  char *p;
+  int i;
+
+  for(i = 0; i < MULTSECT && r->sent < r->npages*SECT_PER_PAGE; i++, r->sent++){
+    p = r->pages[r->sent / SECT_PER_PAGE] + (r->sent % SECT_PER_PAGE) * SECTOR_SIZE;
+    if(r->write)
+      outsl(0x1f0, p, SECTOR_SIZE/4);
+    else
+      insl(0x1f0, p, SECTOR_SIZE/4);
+  }
+}
+
+// Page transfer r is over, whether or not it worked: hand it back
+// and start the next request. Caller must hold idelock.
+static void
+pagedone(struct pagereq *r)
+{
+  pagequeue = r->qnext;
+  pageactive = 0;
+  r->complete = 1;
+  if(r->done)
+    r->done(r);
+  else
+    wakeup(r);
+  idekick();
+}
+
+// Start page transfer r with a single multi-sector command.
+// Caller must hold idelock.
+static void
+idestartpages(struct pagereq *r)
+{
+  int sector = r->blockno * (BSIZE/SECTOR_SIZE);
+  int n = r->npages * SECT_PER_PAGE;
+  int s;
+
+  if(r->blockno + r->npages*(PGSIZE/BSIZE) > FSSIZE || n > 256)
+    panic("idestartpages");
+
+  r->sent = 0;
+  idewait(0);
+  outb(0x3f6, 0);  // generate interrupt
+  outb(0x1f2, n & 0xff);  // number of sectors, 0 means 256
+  outb(0x1f3, sector & 0xff);
+  outb(0x1f4, (sector >> 8) & 0xff);
+  outb(0x1f5, (sector >> 16) & 0xff);
+  outb(0x1f6, 0xe0 | ((r->dev&1)<<4) | ((sector>>24)&0x0f));
+  if(r->write){
+    outb(0x1f7, IDE_CMD_WRMUL);
+    while(((s = inb(0x1f7)) & (IDE_BSY|IDE_DRQ)) != IDE_DRQ)
+      if((s & IDE_BSY) == 0 && (s & (IDE_DF|IDE_ERR)) != 0){
+        // Refused before any data moved.
+        r->error = 1;
+        pagedone(r);
+        return;
+      }
+    pagexfer(r);
+  } else {
+    outb(0x1f7, IDE_CMD_RDMUL);
+  }
+}
+
+// Start whatever is next once the disk is idle.
+// Caller must hold idelock.
+static void
+idekick(void)
+{
+  if(idequeue != 0)
+    idestart(idequeue);
+  else if(pagequeue != 0){
+    pageactive = 1;
+    idestartpages(pagequeue);
+  }
+}
+
+// Interrupt for the active page transfer.
+// Caller must hold idelock.
+static void
+ideintrpages(void)
+{
+  struct pagereq *r = pagequeue;
+
+  if(idewait(1) < 0){
+    // The drive gave up on the command; nothing more will come.
+    r->error = 1;
+    pagedone(r);
+    return;
+  }
+  if(!r->write)
+    pagexfer(r);
+  if(r->sent < r->npages*SECT_PER_PAGE){
+    // The disk wants (or has) the next block.
+    if(r->write)
+      pagexfer(r);
+    return;
+  }
+  pagedone(r);
+}
+
 // Interrupt handler.
 void
 ideintr(void)
 {
   struct buf *b;
 
-  // First queued buffer is the active request.
   acquire(&idelock);
 
+  if(pageactive){
+    ideintrpages();
+    release(&idelock);
+    return;
+  }
+
+  // First queued buffer is the active request.
   if((b = idequeue) == 0){
     release(&idelock);
     return;
@@ -123,9 +256,8 @@ ideintr(void)
   b->flags &= ~B_DIRTY;
   wakeup(b);
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  // Start disk on next request.
+  idekick();
 
   release(&idelock);
 }
@@ -155,7 +287,7 @@ iderw(struct buf *b)
   *pp = b;
 
   // Start disk if necessary.
-  if(idequeue == b)
+  if(idequeue == b && !pageactive)
     idestart(b);
 
   // Wait for request to finish.
@@ -166,3 +298,35 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Queue the page transfer r. If r->done is set, return at once and
+// let ideintr() call it when the transfer has finished; otherwise
+// sleep until then. r->error tells whether the disk failed it.
+void
+idepages(struct pagereq *r)
+{
+  struct pagereq **pp;
+
+  if(r->dev != 0 && !havedisk1)
+    panic("idepages: ide disk 1 not present");
+
+  acquire(&idelock);
+
+  r->complete = 0;
+  r->error = 0;
+  r->qnext = 0;
+  for(pp=&pagequeue; *pp; pp=&(*pp)->qnext)
+    ;
+  *pp = r;
+
+  if(pagequeue == r && idequeue == 0 && !pageactive){
+    pageactive = 1;
+    idestartpages(r);
+  }
+
+  if(r->done == 0)
+    while(!r->complete)
+      sleep(r, &idelock);
+
+  release(&idelock);
+}
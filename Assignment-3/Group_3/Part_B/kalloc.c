@@ -1,12 +1,27 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Free memory is kept by a binary buddy allocator: a free block of
+// order k is 2^k physically contiguous pages whose first page number
+// is a multiple of 2^k. kalloc_order(k) splits larger blocks as needed
+// and kfree_order() merges a block with its free buddy on the way back.
+//
+// Each cpu keeps a small cache of free single pages in struct cpu so
+// that kalloc() and kfree() normally run without touching kmem.lock.
+// A cache is refilled from, and drained to, the buddy lists KBATCH
+// pages at a time.
+//
+// Idle cpus also keep a pool of pages that are already zeroed (see
+// kzero_refill()), so kalloc_zeroed() on the page fault path usually
+// does not have to clear a page itself.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "proc.h"
 #include "spinlock.h"
 #include "kalloc.h"
 
@@ -15,16 +30,50 @@ struct physPagesCounts physPagesCounts;
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
 
+#define NFRAMES (PHYSTOP / PGSIZE)
+
 struct run {
   struct run *next;
+  struct run *prev;            // buddy lists only; cpu caches use next
+};
+
+// What the allocator knows about each physical page. Only the
+// first page of a block is meaningful.
+struct frame {
+  char free;                   // first page of a free buddy block
+  char order;                  // block order, free or allocated
+  char ispgdir;                // page is a live page directory;
+                               //   2 if its process is above its working set
+  int pins;                    // page directory in use by select_a_victim()
+  int refcnt;                  // users of an allocated page; see kdup()
+  pde_t *pgdir;                // reverse map of a user page: the
+  uint va;                     //   mapping that last claimed it
+  int swapslot;                // 1 + swap slot with a copy; see kswapcache()
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run freelist[KMAXORDER+1];  // circular lists of free blocks
+  struct frame frames[NFRAMES];
 } kmem;
 
+// Free pages that have already been zeroed. They still count as free.
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;
+} zpool;
+
+// physPagesCounts.currentFreePagesNo counts pages on the buddy lists,
+// on every cpu cache and on zpool. The cpu caches change it without
+// kmem.lock.
+#define freepages_inc(n) __sync_fetch_and_add(&physPagesCounts.currentFreePagesNo, (n))
+#define freepages_dec(n) __sync_fetch_and_sub(&physPagesCounts.currentFreePagesNo, (n))
+
+#define PFN(v)     (V2P(v) / PGSIZE)
+#define PFN2V(pfn) ((char*)P2V((pfn) * PGSIZE))
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -33,8 +82,13 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int k;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&zpool.lock, "zpool");
   kmem.use_lock = 0;
+  for(k = 0; k <= KMAXORDER; k++)
+    kmem.freelist[k].next = kmem.freelist[k].prev = &kmem.freelist[k];
   freerange(vstart, vend);
 
   // physPagesCounts is a struct defined in kalloc.h to hold info needed to cumpute percent of free physcal pages
@@ -62,7 +116,182 @@ freerange(void *vstart, void *vend)
     kfree(p);
 }
 
+static void
+list_remove(struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+}
+
+static void
+list_push(struct run *head, struct run *r)
+{
+  r->next = head->next;
+  r->prev = head;
+  head->next->prev = r;
+  head->next = r;
+}
+
+// Take a block of 2^order pages off the buddy lists, splitting a
+// larger block if there is no free block of that order.
+// Caller must hold kmem.lock.
+static char*
+buddy_alloc(int order)
+{
+  struct run *r;
+  uint pfn;
+  int k;
+
+  for(k = order; k <= KMAXORDER; k++)
+    if(kmem.freelist[k].next != &kmem.freelist[k])
+      break;
+  if(k > KMAXORDER)
+    return 0;
+
+  r = kmem.freelist[k].next;
+  list_remove(r);
+  physPagesCounts.freeBlocks[k]--;
+  pfn = PFN(r);
+
+  // Give back the upper half until the block is the right size.
+  while(k > order){
+    k--;
+    kmem.frames[pfn + (1<<k)].free = 1;
+    kmem.frames[pfn + (1<<k)].order = k;
+    list_push(&kmem.freelist[k], (struct run*)PFN2V(pfn + (1<<k)));
+    physPagesCounts.freeBlocks[k]++;
+  }
+  kmem.frames[pfn].free = 0;
+  kmem.frames[pfn].order = order;
+  return (char*)r;
+}
+
+// Return a block of 2^order pages to the buddy lists, merging it
+// with its buddy for as long as the buddy is free and whole.
+// Caller must hold kmem.lock.
+static void
+buddy_free(char *v, int order)
+{
+  uint pfn, buddy;
+
+  pfn = PFN(v);
+  while(order < KMAXORDER){
+    buddy = pfn ^ (1 << order);
+    if(buddy + (1 << order) > NFRAMES)
+      break;
+    if(!kmem.frames[buddy].free || kmem.frames[buddy].order != order)
+      break;
+    list_remove((struct run*)PFN2V(buddy));
+    physPagesCounts.freeBlocks[order]--;
+    kmem.frames[buddy].free = 0;
+    if(buddy < pfn)
+      pfn = buddy;
+    order++;
+  }
+  kmem.frames[pfn].free = 1;
+  kmem.frames[pfn].order = order;
+  list_push(&kmem.freelist[order], (struct run*)PFN2V(pfn));
+  physPagesCounts.freeBlocks[order]++;
+}
+
+// Move up to n pages from the buddy lists to the cache of c.
+// Caller must hold kmem.lock.
+static void
+refill(struct cpu *c, int n)
+{
+  struct run *r;
+
+  while(n-- > 0 && (r = (struct run*)buddy_alloc(0)) != 0){
+    r->next = c->pcache;
+    c->pcache = r;
+    c->npcache++;
+  }
+}
+
+// Move up to n pages from the cache of c back to the buddy lists.
+// Caller must hold kmem.lock.
+static void
+drain(struct cpu *c, int n)
+{
+  struct run *r;
+
+  while(n-- > 0 && (r = c->pcache) != 0){
+    c->pcache = r->next;
+    c->npcache--;
+    buddy_free((char*)r, 0);
+  }
+}
+
+// Take a page off zpool, clearing the link word that was
+// stored in it. Returns 0 if the pool is empty.
+static char*
+zpool_get(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock)
+    return 0;   // too early for locks; the pool is empty anyway
+  acquire(&zpool.lock);
+  if((r = zpool.list) != 0){
+    zpool.list = r->next;
+    zpool.n--;
+    freepages_dec(1);
+  }
+  release(&zpool.lock);
+  if(r){
+    r->next = 0;
+    kmem.frames[PFN(r)].refcnt = 1;
+  }
+  return (char*)r;
+}
+
 //PAGEBREAK: 21
+// Free the 2^order physically contiguous pages starting at v,
+// which must have been returned by kalloc_order(order).
+void
+kfree_order(char *v, int order)
+{
+  if((uint)v % (PGSIZE << order) || v < end || V2P(v) >= PHYSTOP)
+    panic("kfree_order");
+  if(order < 0 || order > KMAXORDER)
+    panic("kfree_order: bad order");
+
+#ifdef KDEBUG
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE << order);
+#endif
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.frames[PFN(v)].order != order)
+    panic("kfree_order: order mismatch");
+  buddy_free(v, order);
+  freepages_inc(1 << order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
+// Allocate 2^order physically contiguous pages, aligned to their
+// size. Returns 0 if no block that large is free.
+char*
+kalloc_order(int order)
+{
+  char *v;
+
+  if(order < 0 || order > KMAXORDER)
+    return 0;
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  v = buddy_alloc(order);
+  if(v){
+    kmem.frames[PFN(v)].refcnt = 1;
+    freepages_dec(1 << order);
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return v;
+}
+
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
@@ -71,21 +300,51 @@ void
 kfree(char *v)
 {
   struct run *r;
+  struct cpu *c;
+  int slot;
+
+  if(!kmem.use_lock){
+    // Still booting on one cpu; mycpu() is not usable yet.
+    kmem.frames[PFN(v)].order = 0;
+    kfree_order(v, 0);
+    return;
+  }
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  // A page shared copy-on-write is freed by its last user only.
+  switch(__sync_sub_and_fetch(&kmem.frames[PFN(v)].refcnt, 1)){
+  case 0:
+    break;
+  case -1:
+    panic("kfree: page not allocated");
+  default:
+    return;
+  }
+  kmem.frames[PFN(v)].pgdir = 0;
+  kmem.frames[PFN(v)].ispgdir = 0;
+  if((slot = kswapuncache(v)) >= 0)
+    swap_free(slot);
+
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  physPagesCounts.currentFreePagesNo++;
-  if(kmem.use_lock)
+  pushcli();
+  c = mycpu();
+  r->next = c->pcache;
+  c->pcache = r;
+  c->npcache++;
+  freepages_inc(1);
+  if(c->npcache > NPCACHE){
+    acquire(&kmem.lock);
+    drain(c, KBATCH);
     release(&kmem.lock);
+  }
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -95,15 +354,184 @@ char*
 kalloc(void)
 {
   struct run *r;
+  struct cpu *c;
 
-  if(kmem.use_lock)
+  if(!kmem.use_lock)
+    return kalloc_order(0);
+
+  pushcli();
+  c = mycpu();
+  if(c->pcache == 0){
     acquire(&kmem.lock);
-  r = kmem.freelist;
+    refill(c, KBATCH);
+    release(&kmem.lock);
+  }
+  r = c->pcache;
   if(r){
-    kmem.freelist = r->next;
-    physPagesCounts.currentFreePagesNo--;
+    c->pcache = r->next;
+    c->npcache--;
+    freepages_dec(1);
+    kmem.frames[PFN(r)].refcnt = 1;
   }
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  popcli();
+  if(r == 0)
+    r = (struct run*)zpool_get();
+  if(physPagesCounts.currentFreePagesNo < PAGES_LOW)
+    kswapd_wake();
   return (char*)r;
 }
+
+// Take another reference to the page at v, which must have been
+// returned by kalloc(). The page is freed once kfree() has been
+// called once for every reference.
+void
+kdup(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kdup");
+  __sync_fetch_and_add(&kmem.frames[PFN(v)].refcnt, 1);
+}
+
+// Number of references to the page at v.
+int
+krefcount(char *v)
+{
+  return kmem.frames[PFN(v)].refcnt;
+}
+
+// Record that the user page at v is mapped at va in pgdir, for
+// the page replacement clock in select_a_victim().
+void
+krmap(char *v, pde_t *pgdir, uint va)
+{
+  kmem.frames[PFN(v)].pgdir = pgdir;
+  kmem.frames[PFN(v)].va = va;
+}
+
+// The user page at v, just read in from swap slot, still has an
+// identical copy there. The page holds on to the slot until it is
+// freed or swapped out again, so that a clean page can be evicted
+// without writing it.
+void
+kswapcache(char *v, int slot)
+{
+  kmem.frames[PFN(v)].swapslot = slot + 1;
+}
+
+// Forget the swap copy of the page at v and return its slot, which
+// the caller now owns, or -1 if there is none.
+int
+kswapuncache(char *v)
+{
+  int slot;
+
+  slot = kmem.frames[PFN(v)].swapslot - 1;
+  kmem.frames[PFN(v)].swapslot = 0;
+  return slot;
+}
+
+// Mark the page at v as a page directory until it is freed, so
+// that a reverse map pointing at it can be trusted.
+void
+kmarkpgdir(char *v)
+{
+  kmem.frames[PFN(v)].ispgdir = 1;
+}
+
+// The page directory at v is about to be freed: no new pins.
+void
+kunmarkpgdir(char *v)
+{
+  kmem.frames[PFN(v)].ispgdir = 0;
+}
+
+// Whether pgdir is a page directory that is not being freed.
+int
+kpgdirlive(pde_t *pgdir)
+{
+  return kmem.frames[PFN(pgdir)].ispgdir != 0;
+}
+
+// Add n to the pins of page directory pgdir and return the new
+// count. Only pgdir_pin() and friends use this, under ptable.lock.
+int
+kpgdirpin(pde_t *pgdir, int n)
+{
+  return kmem.frames[PFN(pgdir)].pins += n;
+}
+
+// Record whether the process with page directory pgdir has more
+// pages resident than its working set; see wsscan().
+void
+kpgdirover(char *pgdir, int over)
+{
+  if(kmem.frames[PFN(pgdir)].ispgdir)
+    kmem.frames[PFN(pgdir)].ispgdir = over ? 2 : 1;
+}
+
+// Whether pgdir was last marked above its working set.
+int
+kpgdirisover(pde_t *pgdir)
+{
+  return kmem.frames[PFN(pgdir)].ispgdir == 2;
+}
+
+// If physical frame pfn is a user page with a single user and a
+// reverse map into a live page directory, return that mapping in
+// *pgdir and *va and return 1. Otherwise return 0. The mapping may
+// be stale; the caller must check the PTE still points at pfn.
+int
+krmapget(uint pfn, pde_t **pgdir, uint *va)
+{
+  struct frame *f;
+  pde_t *pd;
+
+  if(pfn >= NFRAMES)
+    return 0;
+  f = &kmem.frames[pfn];
+  pd = f->pgdir;
+  if(f->refcnt != 1 || pd == 0 || !kmem.frames[PFN(pd)].ispgdir)
+    return 0;
+  *pgdir = pd;
+  *va = f->va;
+  return 1;
+}
+
+// Allocate one page of physical memory filled with zeros,
+// preferring a page zeroed earlier by an idle cpu.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_zeroed(void)
+{
+  char *v;
+
+  if((v = zpool_get()) != 0)
+    return v;
+  if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// Called by scheduler() when a pass found nothing to run.
+// Zero up to KBATCH free pages and park them on zpool, unless
+// memory is short enough that they would be better left alone.
+void
+kzero_refill(void)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < KBATCH && zpool.n < NZPOOL; i++){
+    if(physPagesCounts.currentFreePagesNo < 2*NZPOOL)
+      break;
+    if((r = (struct run*)kalloc()) == 0)
+      break;
+    memset(r, 0, PGSIZE);
+    acquire(&zpool.lock);
+    r->next = zpool.list;
+    zpool.list = r;
+    zpool.n++;
+    freepages_inc(1);
+    release(&zpool.lock);
+  }
+}
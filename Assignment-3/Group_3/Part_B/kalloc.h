@@ -1,7 +1,11 @@
+// largest block handed out by kalloc_order(): 2^KMAXORDER pages (4MB)
+#define KMAXORDER 10
+
 // struct for keeping track of the percent of free physical pages
 struct physPagesCounts{
   uint initPagesNo;
   uint currentFreePagesNo;
+  uint freeBlocks[KMAXORDER+1];  // free buddy blocks of each order, for fragmentation stats
 };
 
 extern struct physPagesCounts physPagesCounts;
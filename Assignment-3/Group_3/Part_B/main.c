@@ -18,6 +18,7 @@ int
 main(void)
 {
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
+  slabinit();      // kernel object caches
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
@@ -30,12 +31,15 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  pipeinit();      // pipe object cache
+  textcacheinit(); // shared program pages
+  shminit();       // anonymous shared memory
+  zswapinit();     // compressed swap pool
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   userinit();      // first user process
-  //create_kernel_process("swapout", swapout); // set up the swapper.
-  //create_kernel_process("swapin", swapin);
+  kswapdinit();    // page replacement daemon
   mpmain();        // finish this processor's setup
 }
 
@@ -58,3 +58,27 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// Transfer the pages of r. The memory disk is synchronous, so
+// r->done, if set, is called before returning.
+void
+idepages(struct pagereq *r)
+{
+  uchar *p;
+  int i;
+
+  if(r->blockno + r->npages*(PGSIZE/BSIZE) > disksize)
+    panic("idepages: block out of range");
+
+  p = memdisk + r->blockno*BSIZE;
+  for(i = 0; i < r->npages; i++, p += PGSIZE){
+    if(r->write)
+      memmove(p, r->pages[i], PGSIZE);
+    else
+      memmove(r->pages[i], p, PGSIZE);
+  }
+  r->complete = 1;
+  r->error = 0;
+  if(r->done)
+    r->done(r);
+}
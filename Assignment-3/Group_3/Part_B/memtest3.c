@@ -11,6 +11,10 @@
 int
 main(int argc, char *argv[])
 {
+	int hits, misses;
+
 	printf(1, "Num swapped blocks:%d\n", bstat());
+	if(scstat(&hits, &misses) == 0)
+		printf(1, "Swap cache hits:%d misses:%d\n", hits, misses);
 	exit();
 }
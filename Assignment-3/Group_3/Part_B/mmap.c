@@ -0,0 +1,613 @@
+// Memory-mapped files.
+//
+// mmap() only records a struct vma in the process; pages are read
+// from the file by mmap_fault() when first touched, through the same
+// page fault path as lazily grown heap and program pages.
+//
+//  - MAP_PRIVATE pages that lie wholly inside the file come from the
+//    shared program page cache (textcache.c) and are mapped
+//    copy-on-write; a write makes a private copy. A partial last
+//    page is private from the start.
+//  - MAP_SHARED pages are kept in the file's struct shm, one per
+//    inode, whatever process mapped it. The shm holds a reference on
+//    each of its pages for as long as the file is mapped, so every
+//    mapper sees the same frames, and writei() copies what write()
+//    stores into them. Dirty pages (PTE_D) are written back to the
+//    file, through the log, by munmap() and exit(). Only the first
+//    SHMMAXPG pages of a file can be mapped shared.
+//
+// Mappings are placed between MMAPBASE and KERNBASE, above the heap.
+//
+// MAP_ANONYMOUS mappings have no file and start zero-filled. A
+// MAP_SHARED one is backed by a struct shm of its own, so that every
+// process that inherits the mapping through fork() sees the same
+// memory even for pages first touched after the fork.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "paging.h"
+#include "slab.h"
+
+// Pages of a shared mapping: an anonymous one, or every MAP_SHARED
+// mapping of the file ip, indexed by page of the file.
+struct shm {
+  struct spinlock lock;
+  int ref;                     // vmas using this object
+  uint npages;
+  char **pages;                // one kalloc()ed page of page pointers
+  struct inode *ip;            // 0 if anonymous
+  struct shm *next;            // on fileshm.list
+};
+
+#define SHMMAXPG (PGSIZE / sizeof(char*))
+
+static struct kmem_cache *shmcache;
+
+// The shm of every file that is mapped MAP_SHARED. Lock order:
+// fileshm.lock, then shm.lock.
+static struct {
+  struct spinlock lock;
+  struct shm *list;
+} fileshm;
+
+static int readpage(struct inode *ip, char *mem, uint off);
+
+void
+shminit(void)
+{
+  initlock(&fileshm.lock, "fileshm");
+  if((shmcache = kmem_cache_create("shm", sizeof(struct shm))) == 0)
+    panic("shminit");
+}
+
+static struct shm*
+shmalloc(uint npages)
+{
+  struct shm *s;
+
+  if(npages > SHMMAXPG || (s = kmem_cache_alloc(shmcache)) == 0)
+    return 0;
+  if((s->pages = (char**)kalloc_zeroed()) == 0){
+    kmem_cache_free(shmcache, s);
+    return 0;
+  }
+  initlock(&s->lock, "shm");
+  s->ref = 1;
+  s->npages = npages;
+  s->ip = 0;
+  s->next = 0;
+  return s;
+}
+
+// The shm of the pages of ip, with a reference taken for the caller.
+// Returns 0 if out of memory.
+static struct shm*
+fileshmget(struct inode *ip)
+{
+  struct shm *s;
+
+  acquire(&fileshm.lock);
+  for(s = fileshm.list; s; s = s->next)
+    if(s->ip == ip)
+      break;
+  if(s){
+    acquire(&s->lock);
+    s->ref++;
+    release(&s->lock);
+  } else if((s = shmalloc(SHMMAXPG)) != 0){
+    s->ip = idup(ip);
+    s->next = fileshm.list;
+    fileshm.list = s;
+  }
+  release(&fileshm.lock);
+  return s;
+}
+
+// n bytes at src were just written to ip at off: copy them into the
+// pages that processes have mapped MAP_SHARED, if any.
+void
+mmap_filewrite(struct inode *ip, uint off, char *src, uint n)
+{
+  struct shm *s;
+  uint pg, m;
+
+  if(fileshm.list == 0)
+    return;
+  acquire(&fileshm.lock);
+  for(s = fileshm.list; s; s = s->next)
+    if(s->ip == ip)
+      break;
+  for(; s && n > 0; off += m, src += m, n -= m){
+    pg = off / PGSIZE;
+    m = PGSIZE - off % PGSIZE;
+    if(m > n)
+      m = n;
+    if(pg >= s->npages)
+      break;
+    if(s->pages[pg])
+      memmove(s->pages[pg] + off % PGSIZE, src, m);
+  }
+  release(&fileshm.lock);
+}
+
+static void
+shmdup(struct shm *s)
+{
+  acquire(&s->lock);
+  s->ref++;
+  release(&s->lock);
+}
+
+// Drop a reference to s, freeing its pages with the last one.
+// Processes that still map a page hold their own reference to it.
+static void
+shmput(struct shm *s)
+{
+  struct shm **sp;
+  uint i;
+  int ref;
+
+  acquire(&fileshm.lock);
+  acquire(&s->lock);
+  if((ref = --s->ref) == 0 && s->ip){
+    for(sp = &fileshm.list; *sp != s; sp = &(*sp)->next)
+      ;
+    *sp = s->next;
+  }
+  release(&s->lock);
+  release(&fileshm.lock);
+  if(ref > 0)
+    return;
+  for(i = 0; i < s->npages; i++)
+    if(s->pages[i])
+      kfree(s->pages[i]);
+  kfree((char*)s->pages);
+  if(s->ip){
+    begin_op();
+    iput(s->ip);
+    end_op();
+  }
+  kmem_cache_free(shmcache, s);
+}
+
+// Page i of s, with a reference taken for the caller. On first use
+// it is read from the file, or zeroed if s is anonymous, and *major
+// is set if the file was read. Returns 0 if out of memory or on a
+// read error.
+static char*
+shmpage(struct shm *s, uint i, int *major)
+{
+  char *mem;
+  int locked = 0;
+
+  *major = 0;
+  acquire(&s->lock);
+  if((mem = s->pages[i]) != 0){
+    kdup(mem);
+    release(&s->lock);
+    return mem;
+  }
+  release(&s->lock);
+
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  if(s->ip){
+    // Read and install the page under the inode lock, so that a
+    // write() cannot come in between and miss it.
+    *major = 1;
+    if(!(locked = holdingsleep(&s->ip->lock)))
+      ilock(s->ip);
+    if(readpage(s->ip, mem, i * PGSIZE) < 0){
+      if(!locked)
+        iunlock(s->ip);
+      kfree(mem);
+      return 0;
+    }
+  }
+  acquire(&s->lock);
+  if(s->pages[i]){
+    // Another process got there first.
+    kfree(mem);
+    mem = s->pages[i];
+  } else
+    s->pages[i] = mem;
+  kdup(mem);
+  release(&s->lock);
+  if(s->ip && !locked)
+    iunlock(s->ip);
+  return mem;
+}
+
+// The mapping of p that contains va, or 0.
+struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && va >= v->start && va < v->start + v->len)
+      return v;
+  return 0;
+}
+
+// The mapping of p that holds all of [va, va+n), which the kernel
+// may read, and also write if write is set; or 0. Lets system calls
+// take buffers in mapped memory, which lies above p->sz.
+struct vma*
+vmarange(struct proc *p, uint va, uint n, int write)
+{
+  struct vma *v;
+
+  if((v = findvma(p, va)) == 0 || va + n < va || va + n > v->start + v->len)
+    return 0;
+  if(write && !(v->prot & PROT_WRITE))
+    return 0;
+  return v;
+}
+
+// Is [start, start+len) clear of every mapping of p?
+static int
+vmafree(struct proc *p, uint start, uint len)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && start < v->start + v->len && v->start < start + len)
+      return 0;
+  return 1;
+}
+
+// Map len bytes of f, starting at file offset off, into the current
+// process; f is ignored for MAP_ANONYMOUS. addr is a hint and may
+// be 0. Returns the address of the mapping, or -1.
+int
+mmap(uint addr, uint len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *curproc = myproc();
+  struct vma *v, *fv;
+  uint start;
+
+  if(len == 0 || off % PGSIZE)
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(flags & MAP_ANONYMOUS){
+    f = 0;
+    off = 0;
+  } else {
+    if(f == 0 || f->type != FD_INODE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+  len = PGROUNDUP(len);
+  if(len >= KERNBASE - MMAPBASE)
+    return -1;
+
+  if(addr >= MMAPBASE && addr % PGSIZE == 0 && addr + len <= KERNBASE &&
+     addr + len > addr && vmafree(curproc, addr, len)){
+    start = addr;
+  } else {
+    // First gap above MMAPBASE that is big enough.
+    start = MMAPBASE;
+    for(fv = curproc->vma; fv < &curproc->vma[NVMA]; ){
+      if(fv->len && start < fv->start + fv->len && fv->start < start + len){
+        start = fv->start + fv->len;
+        fv = curproc->vma;
+      } else
+        fv++;
+    }
+    if(start + len > KERNBASE || start + len < start)
+      return -1;
+  }
+
+  for(v = curproc->vma; v < &curproc->vma[NVMA]; v++)
+    if(v->len == 0)
+      goto found;
+  return -1;
+
+found:
+  v->shm = 0;
+  if(flags & MAP_SHARED){
+    if(f == 0)
+      v->shm = shmalloc(len / PGSIZE);
+    else if(off / PGSIZE + len / PGSIZE <= SHMMAXPG)
+      v->shm = fileshmget(f->ip);
+    if(v->shm == 0)
+      return -1;
+  }
+  v->start = start;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = f ? filedup(f) : 0;
+  return start;
+}
+
+// Read the page at file offset off of ip into the zeroed page mem,
+// stopping at the end of the file. Returns the number of bytes
+// read, or -1.
+static int
+readpage(struct inode *ip, char *mem, uint off)
+{
+  int locked, n;
+
+  // The fault may come from a kernel copy into user memory made
+  // while this very inode is locked, e.g. read() into a mapping.
+  locked = holdingsleep(&ip->lock);
+  if(!locked)
+    ilock(ip);
+  n = 0;
+  if(off < ip->size){
+    n = ip->size - off;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    if(readi(ip, mem, off, n) != n)
+      n = -1;
+  }
+  if(!locked)
+    iunlock(ip);
+  return n;
+}
+
+// Bring in the page at va of mapping v of the current process.
+// Returns 1 if it was read from the file, 0 on other success, -1
+// if the process should be killed.
+int
+mmap_fault(struct vma *v, uint va)
+{
+  struct proc *curproc = myproc();
+  struct inode *ip;
+  uint off, perm;
+  pte_t *pte;
+  char *mem;
+  int n, major;
+
+  va = PGROUNDDOWN(va);
+  off = v->off + (va - v->start);
+  if((pte = walkpgdir(curproc->pgdir, (char*)va, 1)) == 0)
+    return -1;
+
+  perm = PTE_P | PTE_U;
+  if(*pte & PTE_SWAPPED){
+    // sys_swap() put out this process's copy of a shared page, whose
+    // frame the shm kept; the dirty bit went with it.
+    swap_free(*pte >> 12);
+    *pte = 0;
+    perm |= PTE_D;
+  }
+
+  if(v->f == 0 || v->shm){
+    major = 0;
+    for(n = 0; n < 2; n++){
+      if(v->shm)
+        mem = shmpage(v->shm, off / PGSIZE, &major);
+      else
+        mem = kalloc_zeroed();
+      if(mem)
+        break;
+      if(textcache_reclaim() == 0)
+        swap_page(curproc->pgdir);
+    }
+    if(mem == 0)
+      return -1;
+    if(v->prot & PROT_WRITE)
+      perm |= PTE_W;
+    *pte = V2P(mem) | perm;
+    lcr3(V2P(curproc->pgdir));
+    return major;
+  }
+
+  ip = v->f->ip;
+  major = 0;
+  if((mem = textcache_get(ip, off)) != 0){
+    n = PGSIZE;
+  } else {
+    major = 1;
+    if((mem = kalloc_zeroed()) == 0){
+      if(textcache_reclaim() == 0)
+        swap_page(curproc->pgdir);
+      if((mem = kalloc_zeroed()) == 0)
+        return -1;
+    }
+    if((n = readpage(ip, mem, off)) < 0){
+      kfree(mem);
+      return -1;
+    }
+    if(n == PGSIZE)
+      textcache_put(ip, off, mem);
+  }
+
+  // A whole page is shared with the cache; a partial one is ours.
+  if(v->prot & PROT_WRITE){
+    if(n < PGSIZE)
+      perm |= PTE_W;
+    else
+      perm |= PTE_COW;
+  }
+  *pte = V2P(mem) | perm;
+  lcr3(V2P(curproc->pgdir));
+  return major;
+}
+
+// Write the page at va of mapping v, held at page, back to the file.
+// The file is never extended. Other processes that map the page keep
+// it, and pages at other offsets stay cached.
+static void
+writeback(struct vma *v, uint va, char *page)
+{
+  struct inode *ip = v->f->ip;
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint off, i, n, m;
+
+  off = v->off + (va - v->start);
+  n = 0;
+  for(i = 0; ; i += m){
+    begin_op();
+    ilock(ip);
+    n = off < ip->size ? ip->size - off : 0;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    if(i >= n){
+      iunlock(ip);
+      end_op();
+      break;
+    }
+    m = n - i;
+    if(m > max)
+      m = max;
+    writei(ip, page + i, off + i, m);
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Unmap [start, start+len) of mapping v from p, writing back dirty
+// shared pages.
+static void
+unmaprange(struct proc *p, struct vma *v, uint start, uint len)
+{
+  uint a, pa;
+  pte_t *pte;
+  char *mem;
+  int major;
+
+  for(a = start; a < start + len; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0)
+      continue;
+    if(*pte & PTE_SWAPPED){
+      // Put out by sys_swap(). A shared page is still in the shm,
+      // and may have been dirty; a private copy is just dropped.
+      swap_free(*pte >> 12);
+      *pte = 0;
+      if(v->f && v->shm &&
+         (mem = shmpage(v->shm, (v->off + a - v->start) / PGSIZE, &major)) != 0){
+        writeback(v, a, mem);
+        kfree(mem);
+      }
+      continue;
+    }
+    if((*pte & PTE_P) == 0)
+      continue;
+    pa = PTE_ADDR(*pte);
+    if(v->f && (v->flags & MAP_SHARED) && (*pte & PTE_D))
+      writeback(v, a, P2V(pa));
+    *pte = 0;
+    kfree(P2V(pa));
+  }
+  lcr3(V2P(p->pgdir));
+}
+
+// Release what an unmapped vma holds and free its slot.
+static void
+vmaclose(struct vma *v)
+{
+  if(v->f)
+    fileclose(v->f);
+  if(v->shm)
+    shmput(v->shm);
+  v->f = 0;
+  v->shm = 0;
+  v->len = 0;
+}
+
+// Remove the mappings of the current process in [addr, addr+len).
+// The range must lie in one mapping and include its first or last
+// page. Returns 0 on success, -1 on error.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+
+  len = PGROUNDUP(len);
+  if(addr % PGSIZE || len == 0 || (v = findvma(curproc, addr)) == 0)
+    return -1;
+  if(addr + len > v->start + v->len || addr + len < addr)
+    return -1;
+  if(addr != v->start && addr + len != v->start + v->len)
+    return -1;
+
+  unmaprange(curproc, v, addr, len);
+  if(len == v->len){
+    vmaclose(v);
+  } else if(addr == v->start){
+    v->start += len;
+    v->off += len;
+    v->len -= len;
+  } else
+    v->len -= len;
+  return 0;
+}
+
+// Remove every mapping of p, as on exit or exec.
+void
+munmapall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    unmaprange(p, v, v->start, v->len);
+    vmaclose(v);
+  }
+}
+
+// Give child np the mappings of p. Shared pages stay shared;
+// writable private pages become copy-on-write in both.
+// Returns 0 on success, -1 if np's page table cannot be grown.
+int
+mmap_fork(struct proc *p, struct proc *np)
+{
+  struct vma *v;
+  pte_t *pte, *npte;
+  uint a;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    for(a = v->start; a < v->start + v->len; a += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0)
+        continue;
+      if((*pte & PTE_SWAPPED) && v->shm == 0){
+        // A private page in swap: the child shares the slot.
+        if((npte = walkpgdir(np->pgdir, (char*)a, 1)) == 0)
+          return -1;
+        swap_dup(*pte >> 12);
+        *npte = *pte;
+        continue;
+      }
+      if((*pte & PTE_P) == 0)
+        continue;
+      if((npte = walkpgdir(np->pgdir, (char*)a, 1)) == 0)
+        return -1;
+      if((v->flags & MAP_PRIVATE) && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      *npte = *pte & ~PTE_D;
+      kdup(P2V(PTE_ADDR(*pte)));
+    }
+  }
+  lcr3(V2P(p->pgdir));
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    np->vma[v - p->vma] = *v;
+    if(v->len && v->f)
+      filedup(v->f);
+    if(v->len && v->shm)
+      shmdup(v->shm);
+  }
+  return 0;
+}
@@ -0,0 +1,260 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+// Checks for file-backed mmap()/munmap().
+
+#define PGSIZE 4096
+#define FSIZE (2*PGSIZE + 100)
+
+char buf[FSIZE];
+
+void
+fail(char *msg)
+{
+	printf(1, "mmaptest: %s FAILED\n", msg);
+	unlink("mmap.tmp");
+	exit();
+}
+
+void
+makefile(void)
+{
+	int fd, i;
+
+	for (i = 0; i < FSIZE; i++)
+		buf[i] = 'a' + i % 26;
+	unlink("mmap.tmp");
+	if ((fd = open("mmap.tmp", O_CREATE | O_RDWR)) < 0)
+		fail("create");
+	if (write(fd, buf, FSIZE) != FSIZE)
+		fail("write");
+	close(fd);
+}
+
+// Does the file hold buf, with byte i replaced by c?
+int
+filehas(int i, char c)
+{
+	char b[FSIZE];
+	int fd, n;
+
+	if ((fd = open("mmap.tmp", O_RDONLY)) < 0)
+		fail("open");
+	n = read(fd, b, FSIZE);
+	close(fd);
+	return n == FSIZE && b[i] == c;
+}
+
+void
+readtest(void)
+{
+	int fd, i;
+	char *p;
+
+	printf(1, "mmap read test\n");
+	makefile();
+	fd = open("mmap.tmp", O_RDONLY);
+	p = mmap(0, FSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == (char*)-1)
+		fail("mmap");
+	close(fd);
+	for (i = 0; i < FSIZE; i++)
+		if (p[i] != buf[i])
+			fail("read contents");
+	// The rest of the last page reads as zero.
+	for (i = FSIZE; i < 3*PGSIZE; i++)
+		if (p[i] != 0)
+			fail("zero tail");
+	if (munmap(p, FSIZE) < 0)
+		fail("munmap");
+	printf(1, "mmap read test ok\n");
+}
+
+void
+privatetest(void)
+{
+	int fd, pid;
+	char *p;
+
+	printf(1, "mmap private test\n");
+	makefile();
+	fd = open("mmap.tmp", O_RDWR);
+	p = mmap(0, FSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (p == (char*)-1)
+		fail("mmap");
+	p[10] = 'X';
+	pid = fork();
+	if (pid < 0)
+		fail("fork");
+	if (pid == 0) {
+		if (p[10] != 'X')
+			fail("child sees parent write");
+		p[10] = 'Y';
+		exit();
+	}
+	wait();
+	if (p[10] != 'X')
+		fail("child write leaked");
+	munmap(p, FSIZE);
+	close(fd);
+	if (!filehas(10, buf[10]))
+		fail("file changed");
+	printf(1, "mmap private test ok\n");
+}
+
+void
+sharedtest(void)
+{
+	int fd, pid;
+	char *p;
+
+	printf(1, "mmap shared test\n");
+	makefile();
+	fd = open("mmap.tmp", O_RDWR);
+	p = mmap(0, FSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == (char*)-1)
+		fail("mmap");
+	close(fd);
+	pid = fork();
+	if (pid < 0)
+		fail("fork");
+	if (pid == 0) {
+		p[PGSIZE + 5] = 'Z';
+		exit();
+	}
+	wait();
+	if (p[PGSIZE + 5] != 'Z')
+		fail("parent does not see child write");
+	p[2*PGSIZE + 7] = 'Q';
+	if (munmap(p, FSIZE) < 0)
+		fail("munmap");
+	if (!filehas(PGSIZE + 5, 'Z') || !filehas(2*PGSIZE + 7, 'Q'))
+		fail("write back");
+	printf(1, "mmap shared test ok\n");
+}
+
+// Two processes that map the file on their own see each other's
+// stores, and write() to the file, while both are running.
+void
+sharedlivetest(void)
+{
+	int fd, pid, up[2], down[2];
+	char *p, *q, c;
+
+	printf(1, "mmap shared live test\n");
+	makefile();
+	fd = open("mmap.tmp", O_RDWR);
+	p = mmap(0, FSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == (char*)-1)
+		fail("mmap");
+	if (p[PGSIZE + 6] != buf[PGSIZE + 6])
+		fail("read contents");
+	if (pipe(up) < 0 || pipe(down) < 0)
+		fail("pipe");
+	pid = fork();
+	if (pid < 0)
+		fail("fork");
+	if (pid == 0) {
+		close(fd);
+		fd = open("mmap.tmp", O_RDWR);
+		q = mmap(0, FSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (q == (char*)-1)
+			fail("child mmap");
+		close(fd);
+		q[5] = 'C';
+		write(up[1], "x", 1);
+		read(down[0], &c, 1);
+		if (q[PGSIZE + 6] != 'P')
+			fail("child does not see parent store");
+		if (q[2*PGSIZE + 1] != 'W')
+			fail("child does not see write()");
+		munmap(q, FSIZE);
+		write(up[1], "x", 1);
+		exit();
+	}
+	read(up[0], &c, 1);
+	if (p[5] != 'C')
+		fail("parent does not see child store");
+	p[PGSIZE + 6] = 'P';
+	// Rewrite the file with write(): the mappings must follow.
+	close(fd);
+	fd = open("mmap.tmp", O_RDWR);
+	memmove(buf, p, FSIZE);
+	buf[2*PGSIZE + 1] = 'W';
+	if (write(fd, buf, FSIZE) != FSIZE)
+		fail("write");
+	close(fd);
+	if (p[2*PGSIZE + 1] != 'W')
+		fail("parent does not see write()");
+	write(down[1], "x", 1);
+	read(up[0], &c, 1);
+	// The child has written its pages back; ours must not undo that.
+	if (munmap(p, FSIZE) < 0)
+		fail("munmap");
+	wait();
+	if (!filehas(5, 'C') || !filehas(PGSIZE + 6, 'P') ||
+	    !filehas(2*PGSIZE + 1, 'W'))
+		fail("write back");
+	close(up[0]); close(up[1]); close(down[0]); close(down[1]);
+	printf(1, "mmap shared live test ok\n");
+}
+
+// System calls take buffers and path names in mapped memory.
+void
+syscalltest(void)
+{
+	int fd, i;
+	char *p, *q;
+
+	printf(1, "mmap syscall test\n");
+	makefile();
+	fd = open("mmap.tmp", O_RDONLY);
+	p = mmap(0, FSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	q = mmap(0, FSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == (char*)-1 || q == (char*)-1)
+		fail("mmap");
+	// read() into a read-only mapping is refused; into a writable
+	// one it works, even from the very file that is mapped.
+	if (read(fd, p, 10) != -1)
+		fail("read into read-only mapping");
+	if (read(fd, q, FSIZE) != FSIZE)
+		fail("read into mapping");
+	close(fd);
+	for (i = 0; i < FSIZE; i++)
+		if (q[i] != buf[i])
+			fail("read into mapping contents");
+	// write() from a read-only mapping, to a file named in a mapping.
+	strcpy(q, "mmap.out");
+	if ((fd = open(q, O_CREATE | O_RDWR)) < 0)
+		fail("open name in mapping");
+	if (write(fd, p, FSIZE) != FSIZE)
+		fail("write from mapping");
+	close(fd);
+	memset(q, 0, FSIZE);
+	fd = open("mmap.out", O_RDONLY);
+	if (read(fd, q, FSIZE) != FSIZE)
+		fail("read back");
+	close(fd);
+	for (i = 0; i < FSIZE; i++)
+		if (q[i] != buf[i])
+			fail("write from mapping contents");
+	unlink("mmap.out");
+	munmap(p, FSIZE);
+	munmap(q, FSIZE);
+	printf(1, "mmap syscall test ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	readtest();
+	privatetest();
+	sharedtest();
+	sharedlivetest();
+	syscalltest();
+	unlink("mmap.tmp");
+	printf(1, "mmaptest: all tests passed\n");
+	exit();
+}
@@ -142,6 +142,12 @@ struct segdesc {
 #define PTE_PS          0x080   // Page Size
 #define PTE_MBZ         0x180   // Bits must be zero
 #define PTE_SWAPPED     0x200   // If the physical page it is pointing to is swapped to disk
+#define PTE_COW         0x400   // Read-only because shared copy-on-write with another process
+
+// Page fault error code bits (tf->err on T_PGFLT)
+#define FEC_PR          0x1     // Page was present: a protection violation
+#define FEC_WR          0x2     // Fault was caused by a write
+#define FEC_U           0x4     // Fault happened in user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
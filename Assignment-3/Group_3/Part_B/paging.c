@@ -9,8 +9,11 @@
 #include "spinlock.h"
 #include "paging.h"
 #include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "kalloc.h"
+#include "vmstat.h"
 
-static pte_t * walkpgdir(pde_t *pgdir, const void *va, int alloc);
 int deallocuvmxv6(pde_t *pgdir, uint oldsz, uint newsz);
 static int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm);
 
@@ -25,18 +28,30 @@ myprocxv6(void) {
   return p;
 }
 
-// Allocate eight consecutive disk blocks. Save the content of the physical page in the pte to the disk blocks and save the block-id into the pte.
-void
+extern int swapcachehits, swapcachemisses;
+
+// Allocate a slot in the swap area. Save the content of the physical page in the pte to the slot and save the slot number into the pte.
+// A page that still has an unchanged copy in swap is not written again.
+// Returns -1, leaving the page mapped, if swap is full.
+int
 swap_page_from_pte(pte_t *pte)
 {
 	uint physicalAddress=PTE_ADDR(*pte);          //PTE_ADDR returns address in pte
 	if(physicalAddress==0)
 	    cprintf("physicalAddress address is zero\n");
-	uint diskPage=balloc_page(ROOTDEV);
-	write_page_to_disk(ROOTDEV,(char*)P2V(physicalAddress),diskPage);    //write this page 
+  char *pg = (char*)P2V(physicalAddress);
+  int diskPage = kswapuncache(pg);              // slot still holding a copy, or -1
+  int hit = diskPage >= 0 && !(*pte & PTE_D);
+
+  if(!hit){
+    if(diskPage >= 0)
+      swap_free(diskPage);                      // the copy in swap is stale
+    if((diskPage = swap_alloc()) < 0)
+      return -1;
+  }
 
   /*
-    Store block id and swapped flag in the pte entry whose page was swapped.
+    Store slot number and swapped flag in the pte entry whose page was swapped.
     So, when next time this pte is dereferenced, we know that the page has been swapped
     and we can bring this page again to memory
   */
@@ -44,90 +59,259 @@ swap_page_from_pte(pte_t *pte)
 	*pte = (diskPage << 12)| PTE_SWAPPED;
 	*pte = *pte & ~PTE_P;
 
+  krmap(pg, 0, 0);
+  vmstat_add(VM_EVICT, 1);
+  if(hit){
+    __sync_fetch_and_add(&swapcachehits, 1);
+    kfree(pg);
+  } else {
+    __sync_fetch_and_add(&swapcachemisses, 1);
+    vmstat_add(VM_SWPOUT, 1);
+    // The swap code frees the frame once the page is on disk.
+    swap_write(diskPage,pg);                    //write this page
+  }
+
   /*
   	WHEN PAGE TABLE ENTRIES ARE MODIFIED, THE HARDWARE STILL USES CACHED ENTRIES IN TLB,
     SO WE NEED TO INVALIDATE TLB ENTRY USING EITHER invlpg INSTRUCTION OR lcr3
   */
+  return 0;
+}
 
-	kfree(P2V(physicalAddress));
-	cprintf("\nReturning from swap page from pte\n");
+/* Select a victim, from any process, and queue its contents for the disk
+   without waiting for the write. Returns 0 if there was nothing to swap out,
+   or no room in swap. */
+int
+swap_page_nowait(pde_t *pgdir)
+{
+  pde_t *victim;
+  int r;
+  pte_t* pte=select_a_victim(pgdir, &victim);     //returns *pte, victim pinned
+  if(pte==0)
+    return 0;
+
+  r = swap_page_from_pte(pte);  //swap victim page to disk
+  // The victim's process has not run anywhere since it was pinned,
+  // so only this cpu can hold the old translation.
+  pgdir_unpin(victim);
+  if(r < 0)
+    return 0;
+  lcr3(V2P(pgdir));         //This operation ensures that the older TLB entries are flushed
+	return 1;
 }
 
-/* Select a victim and swap the contents to the disk.*/
+/* Swap out a victim and wait until its frame is free.
+   Returns 0 if there was nothing to swap out; the caller is then out of
+   memory and kills the faulting process. */
 int
 swap_page(pde_t *pgdir)
 {
-  pte_t* pte=select_a_victim(pgdir);              //returns *pte
-  if(pte==0){                                     //If this is true, victim is not found in 1st attempt. Inside this function
-    cprintf("No victim found in 1st attempt. Clearing access bits.");
-    clearaccessbit(pgdir);                        //Accessbits are cleared,
+  if(swap_page_nowait(pgdir) == 0)
+    return 0;
+  swap_flush(1);            //the caller wants the frame now
+  return 1;
+}
 
-    cprintf("Finding victim again, after clearing access bits of 10%% pages.");
-    pte=select_a_victim(pgdir);                   //then victim is selected again. Victim is found this time.
+// Map a physical page to the virtual address addr. If the page table entry points to a swapped block restore the content of the page from the swapped
+// block and free the swapped block.
 
-    if(pte!=0) cprintf("victim found");
-    else cprintf("Not found even in second attempt." );
+// The segment of p's program image, left on disk by exec(), that
+// contains addr, or 0.
+static struct segment*
+find_segment(struct proc *p, uint addr)
+{
+  struct segment *s;
+
+  for(s = p->seg; s < &p->seg[NSEG]; s++)
+    if(s->ip && addr >= s->va && addr < s->va + s->memsz)
+      return s;
+  return 0;
+}
+
+// Fill the zeroed page mem with the page at addr of segment s.
+// Returns 0 on success, -1 on a read error.
+static int
+read_segment_page(struct segment *s, char *mem, uint addr)
+{
+  uint n, off;
+  int locked, r;
+
+  off = addr - s->va;
+  if(off >= s->filesz)
+    return 0;                                   // all bss
+  n = s->filesz - off;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  // The fault may come from a kernel copy into user memory made
+  // while this very inode is locked, e.g. read() from the binary.
+  locked = holdingsleep(&s->ip->lock);
+  if(!locked)
+    ilock(s->ip);
+  r = readi(s->ip, mem, s->off + off, n);
+  if(!locked)
+    iunlock(s->ip);
+  return r == n ? 0 : -1;
+}
+
+// Map the page read from slot at va. Mapped clean: PTE_D tells
+// whether the copy in swap is still good.
+static void
+swapin_map(pde_t *pgdir, uint va, uint slot, char *mem, int accessed)
+{
+  pte_t *pte = walkpgdir(pgdir, (char*)va, 0);
+
+  *pte = V2P(mem) | PTE_W | PTE_U | PTE_P | (accessed ? PTE_A : 0);
+  if(swap_cacheable())
+    kswapcache(mem, slot);
+  else
+    swap_free(slot);
+  krmap(mem, pgdir, va);
+}
+
+// Swap in the page at va of p from slot into mem, and read ahead
+// the pages after va that went out to the slots after slot. The
+// window doubles, up to SWAPBATCH pages, each time p faults just
+// past what was read last, and halves when it faults elsewhere.
+// Pages read ahead are mapped unreferenced, so the clock takes
+// them first if p never touches them.
+// Returns -1, with every page still swapped and mem freed, if the
+// disk could not read them.
+static int
+swapin(struct proc *p, pde_t *pgdir, uint va, uint slot, char *mem)
+{
+  char *pgs[SWAPBATCH];
+  pte_t *pte;
+  uint nva;
+  int i, n;
+
+  if(va == p->ranext){
+    if(p->rawindow < SWAPBATCH)
+      p->rawindow *= 2;
+  } else if(p->rawindow > 1)
+    p->rawindow /= 2;
+
+  pgs[0] = mem;
+  for(n = 1; n < p->rawindow; n++){
+    nva = va + n*PGSIZE;
+    if(nva >= p->sz || nva >= MMAPBASE)
+      break;
+    pte = walkpgdir(pgdir, (char*)nva, 0);
+    if(pte == 0 || !(*pte & PTE_SWAPPED) || (*pte >> 12) != slot + n)
+      break;
+    // Read ahead only while memory is plentiful.
+    if(physPagesCounts.currentFreePagesNo < PAGES_LOW || (pgs[n] = kalloc()) == 0)
+      break;
   }
-  else{                                           //This else is true, then victim is found in first attempt.
-    cprintf("Victim found in 1st attempt.");
+  if(swap_read_pages(slot, pgs, n) < 0){
+    for(i = 0; i < n; i++)
+      kfree(pgs[i]);
+    return -1;
   }
+  vmstat_add(VM_SWPIN, n);
 
-  swap_page_from_pte(pte);  //swap victim page to disk
-  lcr3(V2P(pgdir));         //This operation ensures that the older TLB entries are flushed
-	return 1;
+  for(i = 0; i < n; i++)
+    swapin_map(pgdir, va + i*PGSIZE, slot + i, pgs[i], i == 0);
+  lcr3(V2P(pgdir));
+  p->ranext = va + n*PGSIZE;
+  return 0;
 }
 
-// Map a physical page to the virtual address addr. If the page table entry points to a swapped block restore the content of the page from the swapped
-// block and free the swapped block.
-
 /*
 i) kalloc a physical page
 ii) map physical page to virtual page (addr)
 iii) Set the access bit of the page (last 12 bits are same in physical and virtual page), so they share the access bit
+Returns VM_MAJFLT if the page had to be read from a file or swap, else VM_MINFLT.
 */
 
-void
+int
 map_address(pde_t *pgdir, uint addr)
 {
 	struct proc *curproc = myprocxv6();
 	uint cursz = curproc->sz;
-	uint a = PGROUNDDOWN(rcr2());			            // rounds the address to a multiple of page size (PGSIZE)
+	uint a = PGROUNDDOWN(addr);			            // rounds the address to a multiple of page size (PGSIZE)
 
   pte_t *pte = walkpgdir(pgdir, (char*)a, 0);
   int blockid = -1;                             // disk id where the page was swapped
+  int swapped = (pte != 0 && (*pte & PTE_SWAPPED));
+  struct segment *seg = swapped ? 0 : find_segment(curproc, a);
+  int perm = PTE_W;
+  struct vma *v;
+  char *mem;
+  int r;
+
+  // A shared mapping maps its own frame again, even if sys_swap()
+  // put this process's copy out.
+  if((v = findvma(curproc, a)) != 0 && (!swapped || v->shm)){
+    if((r = mmap_fault(v, a)) < 0){
+      cprintf("pid %d %s: cannot map page 0x%x of a file--kill proc\n",
+              curproc->pid, curproc->name, a);
+      curproc->killed = 1;
+    }
+    return r > 0 ? VM_MAJFLT : VM_MINFLT;
+  }
+
+  // A page that lies wholly in the file part of the program is
+  // shared, copy-on-write, with every other process running it.
+  int shared = seg != 0 && a - seg->va + PGSIZE <= seg->filesz;
+  uint fileoff = shared ? seg->off + (a - seg->va) : 0;
+  if(shared && (mem = textcache_get(seg->ip, fileoff)) != 0){
+    if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_U | PTE_COW) < 0){
+      kfree(mem);
+      panic("map_address: mappages");
+    }
+    return VM_MINFLT;
+  }
 
-	char *mem = kalloc();                         //allocate a physical page
+  // A page coming back from disk is overwritten anyway; a fresh one
+  // must be zero, which the pre-zeroed pool usually has ready.
+	mem = swapped ? kalloc() : kalloc_zeroed();   //allocate a physical page
 
   if(mem==0){
-		// xv6 swapping 
-    swap_page(pgdir);
-    mem = kalloc();                             // now a physical page has been swapped to disk and free, so this time we will get physical page for sure.
-    cprintf("kalloc success\n");
+		// xv6 swapping, unless idle program pages can go first
+    if(textcache_reclaim() == 0)
+      swap_page(pgdir);
+    mem = swapped ? kalloc() : kalloc_zeroed();   // now a physical page has been swapped to disk and free, so this time we will get physical page for sure.
+    if(mem == 0){
+      cprintf("pid %d %s: out of memory--kill proc\n", curproc->pid, curproc->name);
+      curproc->killed = 1;
+      return VM_MINFLT;
+    }
 	}
 
-  if(pte!=0){
-    if(*pte & PTE_SWAPPED){
-      blockid=getswappedblk(pgdir,a);           // disk id where the page was swapped
-      read_page_from_disk(ROOTDEV, mem, blockid);
-
-      *pte=V2P(mem) | PTE_W | PTE_U | PTE_P;
-      *pte &= ~PTE_SWAPPED;
-      lcr3(V2P(pgdir));
-      bfree_page(ROOTDEV,blockid);
+  if(swapped){
+    blockid=getswappedblk(pgdir,a);             // swap slot where the page was swapped
+    if(swapin(curproc, pgdir, a, blockid, mem) < 0){
+      cprintf("pid %d %s: cannot read page 0x%x from swap--kill proc\n",
+              curproc->pid, curproc->name, a);
+      curproc->killed = 1;
+      return VM_MAJFLT;
     }
-    else {
-      memset(mem,0,PGSIZE);
-    	if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_P | PTE_W | PTE_U )<0){
-    		panic("allocuvm out of memory xv6 in mappages/n");
-    		deallocuvmxv6(pgdir,cursz+PGSIZE, cursz);
-    		kfree(mem);
-    	}
-    	else{
-    		cprintf("Mappages working\n");
-    	}
+  }
+  else {
+    if(seg && read_segment_page(seg, mem, a) < 0){
+      cprintf("pid %d %s: cannot read page 0x%x of its program--kill proc\n",
+              curproc->pid, curproc->name, a);
+      curproc->killed = 1;
+      kfree(mem);
+      return VM_MAJFLT;
+    }
+    if(shared){
+      textcache_put(seg->ip, fileoff, mem);
+      perm = PTE_COW;
     }
+  	if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_P | perm | PTE_U )<0){
+  		panic("allocuvm out of memory xv6 in mappages/n");
+  		deallocuvmxv6(pgdir,cursz+PGSIZE, cursz);
+  		kfree(mem);
+  	}
+  	else{
+  		krmap(mem, pgdir, a);
+  	}
   }
 
+  if(swapped || (seg && a - seg->va < seg->filesz))
+    return VM_MAJFLT;
+  return VM_MINFLT;
 }
 
 // page fault handler 
@@ -136,35 +320,47 @@ handle_pgfault()
 {
 	unsigned addr;
 	struct proc *curproc = myprocxv6();
+	uint64 start = rdtsc();
 	asm volatile ("movl %%cr2, %0 \n\t" : "=r" (addr));
 	addr &= ~0xfff;
-	map_address(curproc->pgdir, addr);
+	vmstat_fault(map_address(curproc->pgdir, addr), start);
 }
 
-
-// Return the address of the PTE in page table pgdir that corresponds to virtual address va.  If alloc!=0, create any required page table pages. 
-static pte_t* walkpgdir(pde_t *pgdir, const void *va, int alloc)
+// Take the faults on the user pages [va, va+n) of the current process
+// now, making them present, and private if write is set. A system
+// call may touch them while holding a spinlock (e.g. pipewrite()),
+// where a fault that reads the program file or swap would sleep.
+// Returns -1 if a page cannot be mapped; the process is then killed.
+int
+prefault(uint va, uint n, int write)
 {
-  pde_t *pde;
-  pte_t *pgtab;
+  struct proc *curproc = myproc();
+  pde_t *pgdir = curproc->pgdir;
+  pte_t *pte;
+  uint a, last;
+  uint64 start;
 
-  pde = &pgdir[PDX(va)];
-  if(*pde & PTE_P){
-    pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
-  } 
-  else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+  if(n == 0)
+    return 0;
+  last = PGROUNDDOWN(va + n - 1);
+  for(a = PGROUNDDOWN(va); ; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(pte == 0 || (*pte & PTE_P) == 0){
+      start = rdtsc();
+      vmstat_fault(map_address(pgdir, a), start);
+      pte = walkpgdir(pgdir, (char*)a, 0);
+    }
+    if(pte == 0 || (*pte & PTE_P) == 0 || curproc->killed)
+      return -1;
+    if(write && (*pte & PTE_COW) && cowfault(pgdir, a) < 0){
+      cprintf("pid %d %s: out of memory--kill proc\n",
+              curproc->pid, curproc->name);
+      curproc->killed = 1;
+      return -1;
+    }
+    if(a == last)
       return 0;
-    
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
-    
-    // The permissions here are overly generous, but they can
-    // be further restricted by the permissions in the page table
-    // entries, if necessary.
-    *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
   }
-  return &pgtab[PTX(va)];
 }
 
 // Deallocate user pages to bring the process size from oldsz to
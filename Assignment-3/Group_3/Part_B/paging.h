@@ -2,12 +2,14 @@
 #define PAGING_H
 
 void handle_pgfault();
-pte_t* select_a_victim(pde_t *pgdir);
-void clearaccessbit(pde_t *pgdir);
+pte_t* select_a_victim(pde_t *pgdir, pde_t **victim);
 int getswappedblk(pde_t *pgdir, uint va);
 int swap_page(pde_t *pgdir);
-void swap_page_from_pte(pte_t *pte);
-void map_address(pde_t *pgdir, uint addr);
+int swap_page_nowait(pde_t *pgdir);
+int swap_page_from_pte(pte_t *pte);
+int map_address(pde_t *pgdir, uint addr);
+int prefault(uint va, uint n, int write);
 pte_t *uva2pte(pde_t *pgdir, uint uva);
+pte_t *walkpgdir(pde_t *pgdir, const void *va, int alloc);
 
 #endif
@@ -10,5 +10,18 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       128000  // size of file system in blocks
+#define FSSIZE       218112  // size of disk in blocks, file system and swap
+#define SWAPSLOTS    12288  // pages of swap reserved at the end of the disk
+#define PAGES_LOW      32  // kswapd starts evicting below this many free pages
+#define PAGES_HIGH     64  // and stops once this many are free
+#define SWAPBATCH      16  // pages merged into one swap disk write
+#define ZSWAPPAGES    128  // memory pages the compressed swap pool may use
+#define WSINTERVAL     50  // ticks between working set samples
+#define MLFQBOOST     100  // ticks between MLFQ priority boosts
+#define NPCACHE      16  // max free pages cached per cpu by kalloc
+#define KBATCH        8  // pages moved between a cpu cache and kmem at once
+#define NZPOOL       32  // pre-zeroed pages kept ready for kalloc_zeroed
+#define NSEG          4  // ELF segments per process paged in from the binary
+#define NTEXTPG      64  // program pages kept in the shared text cache
+#define NVMA          8  // mmap() regions per process
 
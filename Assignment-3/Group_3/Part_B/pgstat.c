@@ -0,0 +1,54 @@
+// Paging statistics.
+//
+// Each cpu counts into its own struct vmstat, so the fault path
+// takes no lock; getvmstat() copies out all of them. Fault latency
+// is measured with the time stamp counter and kept as a histogram
+// of log2(cycles) per class of fault.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "vmstat.h"
+
+struct vmstat vmstats[NCPU];
+
+// Add n to counter ev of this cpu.
+void
+vmstat_add(int ev, int n)
+{
+  pushcli();
+  vmstats[cpuid()].count[ev] += n;
+  popcli();
+}
+
+// Count a fault of class cls (VM_MINFLT, VM_MAJFLT or VM_COWFLT)
+// that started when the time stamp counter read start.
+void
+vmstat_fault(int cls, uint64 start)
+{
+  uint64 t;
+  int b;
+
+  t = rdtsc() - start;
+  for(b = 0; b < NVMHIST-1 && (t >> (b+1)) != 0; b++)
+    ;
+  pushcli();
+  vmstats[cpuid()].count[cls]++;
+  vmstats[cpuid()].hist[cls][b]++;
+  popcli();
+}
+
+// Copy the statistics of the first n cpus to st.
+// Returns the number of cpus.
+int
+getvmstat(struct vmstat *st, int n)
+{
+  int i;
+
+  for(i = 0; i < n && i < ncpu; i++)
+    st[i] = vmstats[i];
+  return ncpu;
+}
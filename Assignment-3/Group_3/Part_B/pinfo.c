@@ -0,0 +1,35 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "processInfo.h"
+
+// Print the memory use of each process, as sampled by the kernel.
+// usage: pinfo [pid...]
+
+void
+show(int pid)
+{
+	struct processInfo info;
+
+	if(getProcInfo(pid, &info) < 0)
+		return;
+	printf(1, "%d\t%d\t%d\t%d\t%d\t%d\n", pid, info.ppid, info.psize / 1024,
+	       info.rss, info.nswapped, info.wss);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i;
+
+	printf(1, "pid\tppid\tkb\trss\tswapped\twss\n");
+	if(argc > 1){
+		for(i = 1; i < argc; i++)
+			show(atoi(argv[i]));
+	} else {
+		// pids are handed out in order, so the live ones are below ours
+		for(i = 1; i <= getpid(); i++)
+			show(i);
+	}
+	exit();
+}
@@ -7,6 +7,8 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
+#include "paging.h"
 
 #define PIPESIZE 512
 
@@ -19,6 +21,17 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+// A struct pipe is much smaller than a page, so pipes come from
+// their own object cache instead of kalloc().
+static struct kmem_cache *pipecache;
+
+void
+pipeinit(void)
+{
+  if((pipecache = kmem_cache_create("pipe", sizeof(struct pipe))) == 0)
+    panic("pipeinit");
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +41,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = kmem_cache_alloc(pipecache)) == 0)
     goto bad;
   p->readopen = 1;
   p->writeopen = 1;
@@ -48,7 +61,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    kmem_cache_free(pipecache, p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,7 +82,7 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    kmem_cache_free(pipecache, p);
   } else
     release(&p->lock);
 }
@@ -89,6 +102,12 @@ pipewrite(struct pipe *p, char *addr, int n)
       }
       wakeup(&p->nread);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      // The rest of addr may have been paged out meanwhile; it is
+      // touched below with p->lock held, where a fault cannot sleep.
+      release(&p->lock);
+      if(prefault((uint)addr + i, n - i, 0) < 0)
+        return -1;
+      acquire(&p->lock);
     }
     p->data[p->nwrite++ % PIPESIZE] = addr[i];
   }
@@ -109,6 +128,11 @@ piperead(struct pipe *p, char *addr, int n)
       return -1;
     }
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    // As in pipewrite().
+    release(&p->lock);
+    if(prefault((uint)addr, n, 1) < 0)
+      return -1;
+    acquire(&p->lock);
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
     if(p->nread == p->nwrite)
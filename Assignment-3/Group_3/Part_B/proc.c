@@ -7,6 +7,8 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "paging.h"
+#include "kalloc.h"
+#include "processInfo.h"
 
 #define NOMUTEX  50  
 #define NQUEUE   5  
@@ -28,6 +30,13 @@ struct {
   int chanswapout;
 } swap;
 
+// Multi-level feedback queue, with 'make SCHEDFLAG=MLFQ'.
+// RUNNABLE processes wait in queue[p->priority], level 0 first.
+// A process that uses up the quantum of its level moves down one
+// level; one that sleeps first keeps its level, so interactive
+// processes stay on top. Every MLFQBOOST ticks every process goes
+// back to level 0, so that none starves below a stream of
+// interactive ones. All of it is protected by ptable.lock.
 struct qnode {
   struct proc *p;
   struct qnode *next;
@@ -35,7 +44,6 @@ struct qnode {
 };
 
 struct {
-  struct spinlock qlock;  
   struct qnode *head;
   struct qnode *tail;
   int size;
@@ -45,6 +53,8 @@ struct qnode qnodes[NPROC];
 
 struct qnode *freenode;
 
+#define QUANTUM(level) (1 << (level))   // ticks
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -56,7 +66,123 @@ static void wakeup1(void *chan);
 void
 pinit(void)
 {
+  struct qnode *qn;
+
   initlock(&ptable.lock, "ptable");
+  for(qn = qnodes; qn < &qnodes[NPROC]; qn++){
+    qn->next = freenode;
+    freenode = qn;
+  }
+}
+
+#ifdef MLFQ
+static uint lastboost;                  // ticks at the last boost()
+
+// Append qn to the queue of its process's level.
+static void
+_queue_add(struct qnode *qn)
+{
+  int priority;
+  priority = qn->p->priority;
+  qn->next = 0;
+  qn->prev = queue[priority].tail;
+  if (queue[priority].size == 0)
+    queue[priority].head = qn;
+  else
+    queue[priority].tail->next = qn;
+  queue[priority].tail = qn;
+  queue[priority].size++;
+}
+
+// Take the first process off the highest non-empty level,
+// or return 0 if nothing is RUNNABLE.
+static struct proc*
+_queue_remove(void)
+{
+  struct qnode *qn;
+  struct proc *p;
+  int priority;
+
+  for(priority = 0; priority < NQUEUE; priority++)
+    if(queue[priority].size > 0)
+      break;
+  if(priority == NQUEUE)
+    return 0;
+  qn = queue[priority].head;
+  queue[priority].head = qn->next;
+  if(qn->next)
+    qn->next->prev = 0;
+  else
+    queue[priority].tail = 0;
+  queue[priority].size--;
+  p = qn->p;
+  qn->next = freenode;
+  freenode = qn;
+  return p;
+}
+
+// Move every process back to level 0 with a fresh quantum.
+static void
+boost(void)
+{
+  struct proc *p;
+  int priority;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    p->priority = 0;
+    p->ticksleft = QUANTUM(0);
+  }
+  for(priority = 1; priority < NQUEUE; priority++){
+    if(queue[priority].size == 0)
+      continue;
+    if(queue[0].size == 0)
+      queue[0].head = queue[priority].head;
+    else
+      queue[0].tail->next = queue[priority].head;
+    queue[priority].head->prev = queue[0].tail;
+    queue[0].tail = queue[priority].tail;
+    queue[0].size += queue[priority].size;
+    queue[priority].head = queue[priority].tail = 0;
+    queue[priority].size = 0;
+  }
+}
+#endif
+
+// Make p RUNNABLE. Caller must hold ptable.lock.
+static void
+setrunnable(struct proc *p)
+{
+#ifdef MLFQ
+  struct qnode *qn;
+
+  if((qn = freenode) == 0)
+    panic("setrunnable");
+  freenode = qn->next;
+  qn->p = p;
+  _queue_add(qn);
+#endif
+  p->state = RUNNABLE;
+}
+
+// Called on every clock tick taken by the running process.
+// Returns whether it should give up the cpu.
+int
+timeslice(void)
+{
+#ifdef MLFQ
+  struct proc *p = myproc();
+  int priority, preempt;
+
+  acquire(&ptable.lock);
+  preempt = --p->ticksleft <= 0;
+  for(priority = 0; priority < p->priority; priority++)
+    if(queue[priority].size > 0)
+      preempt = 1;
+  release(&ptable.lock);
+  return preempt;
+#else
+  return 1;
+#endif
 }
 
 // Must be called with interrupts disabled
@@ -121,6 +247,11 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->ranext = 0;
+  p->rawindow = 1;
+  p->rss = p->nswapped = p->wss = 0;
+  p->priority = 0;
+  p->ticksleft = QUANTUM(0);
 
   release(&ptable.lock);
 
@@ -176,7 +307,7 @@ userinit(void)
   p->cwd = namei("/");
 
   acquire(&ptable.lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   release(&ptable.lock);
 }
 
@@ -187,7 +318,7 @@ growproc(int n)
 {
   struct proc *curproc = myproc();
 
-  if (n < 0 || n > KERNBASE || curproc->sz + n > KERNBASE)
+  if (n < 0 || n > MMAPBASE || curproc->sz + n > MMAPBASE)
 	  return -1;
   curproc->sz += n;
   return 0;
@@ -216,6 +347,13 @@ fork(void)
     np->state = UNUSED;
     return -1;
   }
+  if(mmap_fork(curproc, np) < 0){
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
@@ -227,12 +365,17 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  for(i = 0; i < NSEG; i++){
+    np->seg[i] = curproc->seg[i];
+    if(np->seg[i].ip)
+      idup(np->seg[i].ip);
+  }
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
   acquire(&ptable.lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&ptable.lock);
   return pid;
 }
@@ -250,6 +393,9 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  // Write back and drop mapped files.
+  munmapall(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -260,6 +406,12 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  for(fd = 0; fd < NSEG; fd++){
+    if(curproc->seg[fd].ip){
+      iput(curproc->seg[fd].ip);
+      curproc->seg[fd].ip = 0;
+    }
+  }
   end_op();
   curproc->cwd = 0;
 
@@ -344,17 +496,35 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
 
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
+#ifdef MLFQ
+    // Run the first process of the highest non-empty level.
+    if(ticks - lastboost >= MLFQBOOST){
+      boost();
+      lastboost = ticks;
+    }
+    if((p = _queue_remove()) != 0 && kpgdirpin(p->pgdir, 0)){
+      // Its pages are being swapped out; see pgdir_pin().
+      setrunnable(p);
+      p = 0;
+    }
+    if(p){
+#else
+    // Loop over process table looking for process to run.
+    // Skip one whose pages are being swapped out; see pgdir_pin().
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
+      if(p->state != RUNNABLE || kpgdirpin(p->pgdir, 0))
         continue;
+#endif
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -372,6 +542,10 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Nothing to run: use the idle time to zero pages ahead of
+    // the page faults that will want them.
+    if(!ran)
+      kzero_refill();
   }
 }
 
@@ -401,12 +575,70 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// The page replacement clock reaches other processes' page tables
+// through the reverse map. pgdir_pin() keeps such a page directory
+// from being freed, and its process from being scheduled, until
+// pgdir_unpin(); so the clock can change its PTEs without a TLB
+// shootdown. It fails if pgdir is being freed or is in use on
+// another cpu. freevm() calls pgdir_drain() to wait for the pins.
+// The caller's own page directory needs no pin, and must not get one:
+// the caller may sleep while holding it.
+int
+pgdir_pin(pde_t *pgdir)
+{
+  struct cpu *c;
+  int ok;
+
+  if(myproc() && pgdir == myproc()->pgdir)
+    return 1;
+  acquire(&ptable.lock);
+  ok = kpgdirlive(pgdir);
+  for(c = cpus; ok && c < &cpus[ncpu]; c++)
+    if(c != mycpu() && c->proc && c->proc->pgdir == pgdir)
+      ok = 0;
+  if(ok)
+    kpgdirpin(pgdir, 1);
+  release(&ptable.lock);
+  return ok;
+}
+
+void
+pgdir_unpin(pde_t *pgdir)
+{
+  if(myproc() && pgdir == myproc()->pgdir)
+    return;
+  acquire(&ptable.lock);
+  if(kpgdirpin(pgdir, -1) == 0)
+    wakeup1(pgdir);
+  release(&ptable.lock);
+}
+
+// pgdir is about to be freed: stop new pins and wait for the
+// current ones to go.
+void
+pgdir_drain(pde_t *pgdir)
+{
+  acquire(&ptable.lock);
+  kunmarkpgdir((char*)pgdir);
+  while(kpgdirpin(pgdir, 0) > 0)
+    sleep(pgdir, &ptable.lock);
+  release(&ptable.lock);
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
+  struct proc *p = myproc();
+
   acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  if(p->ticksleft <= 0){
+    // Used up its quantum: move down a level.
+    if(p->priority < NQUEUE - 1)
+      p->priority++;
+    p->ticksleft = QUANTUM(p->priority);
+  }
+  setrunnable(p);
   sched();
   release(&ptable.lock);
 }
@@ -427,6 +659,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -481,7 +714,7 @@ wakeup1(void *chan)
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+      setrunnable(p);
 }
 
 // Wake up all processes sleeping on chan.
@@ -507,7 +740,7 @@ kill(int pid)
       p->killed = 1;
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+        setrunnable(p);
       release(&ptable.lock);
       return 0;
     }
@@ -627,43 +860,6 @@ mtx_unlock(int lock_id)
   return 0;
 }
 
-void
-_queue_remove(struct qnode *qn)
-{
-  int priority;
-  priority = qn->p->priority;
-  if (queue[priority].size == 1){
-    queue[priority].head = 0;
-    queue[priority].tail = 0;
-  } else if (queue[priority].head == qn) {
-    qn->next->prev = 0;
-    queue[priority].head = qn->next;
-  } else if (queue[priority].tail == qn) {
-    qn->prev->next = 0;
-    queue[priority].tail = qn->prev;
-  } else {
-    qn->prev->next = qn->next;
-    qn->next = qn->prev;
-  }
-  queue[priority].size--;
-}
-
-void
-_queue_add(struct qnode *qn)
-{
-  int priority;
-  priority = qn->p->priority;
-  if (queue[priority].size == 0){
-    queue[priority].head = qn;
-    queue[priority].tail = qn;
-  } else {
-    queue[priority].tail->next = qn;
-    qn->prev = queue[priority].tail;
-    qn->next = 0;
-    queue[priority].tail = qn;
-  }
-  queue[priority].size++;
-}
 */
 
 
@@ -710,68 +906,160 @@ swapin(void){
 
 */
 
-void
+// A kernel thread's first scheduling switches to here, the same way
+// a new user process starts in forkret.
+static void
+kthreadret(void)
+{
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+  myproc()->kentry();
+  panic("kernel thread returned");
+}
+
+// Start a process that runs entrypoint in the kernel and never
+// returns to user space.
+struct proc*
 create_kernel_process(const char *name, void (*entrypoint)()){
   struct proc *np;
-  struct qnode *qn;
-  
+
   if ((np = allocproc()) == 0) panic("Failing allocating kernel process");
-  
-  qn = freenode;
-  freenode = freenode->next;
 
-  if(freenode != 0) {
-    freenode->prev = 0;
-  }
-  
   if((np->pgdir = setupkvm()) == 0){
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     panic("Failed setup pgdir for kernel process");
   }
-  
-  np->sz = PGSIZE;
-  np->parent = initproc; 
-  memset(np->tf, 0, sizeof(*np->tf));
-  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
-  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
-  np->tf->es = np->tf->ds;
-  np->tf->ss = np->tf->ds;
-  np->tf->eflags = FL_IF;
-  np->tf->esp = PGSIZE;
-
-  // beginning of initcode.S
-  np->tf->eip = 0;              
-  
-  // Set eax = 0 so that fork return 0 in the child
-  np->tf->eax = 0;
+
+  np->sz = 0;
+  np->parent = initproc;
   np->cwd = namei("/");
-  safestrcpy(np->name, name, sizeof(name));
-  qn->p = np;
+  np->kentry = entrypoint;
+  safestrcpy(np->name, name, sizeof(np->name));
 
   // lock to force the compiler to emit the np-state write last.
   acquire(&ptable.lock);
-  np->context->eip = (uint)entrypoint;
-  np->state = RUNNABLE;
+  np->context->eip = (uint)kthreadret;
+  setrunnable(np);
   release(&ptable.lock);
+  return np;
 }
 
+// Fill *info for process pid. Returns -1 if there is none.
+int
+getProcInfo(int pid, struct processInfo *info)
+{
+  struct proc *p;
 
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != UNUSED && p->pid == pid){
+      info->ppid = p->parent ? p->parent->pid : 0;
+      info->psize = p->sz;
+      info->rss = p->rss;
+      info->nswapped = p->nswapped;
+      info->wss = p->wss;
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
 
+// Page replacement daemon: keeps at least PAGES_LOW pages free so
+// that page faults rarely have to swap a page out themselves. Every
+// WSINTERVAL ticks it also samples the working sets.
+static struct proc *kswapdproc;
+static struct spinlock kswapdlock;
+static uint lastscan;            // ticks at the last wsscan()
+
+// Update rss, nswapped and wss of every user process that is not
+// running from its page table and access bits, and tell
+// select_a_victim() which processes hold more pages than they use.
+// Running processes keep their last sample; another cpu may be
+// setting their access bits through its TLB.
+static void
+wsscan(void)
+{
+  extern int nwsover;
+  struct proc *p;
+  int over;
 
+  over = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->kentry || p->pgdir == 0)
+      continue;
+    if(p->state == SLEEPING || p->state == RUNNABLE){
+      p->wss = wsample(p->pgdir, &p->rss, &p->nswapped);
+      kpgdirover((char*)p->pgdir, p->rss > p->wss);
+    }
+    if(p->state != UNUSED && p->state != ZOMBIE && p->rss > p->wss)
+      over++;
+  }
+  nwsover = over;
+  release(&ptable.lock);
+}
 
+static void
+kswapd(void)
+{
+  struct proc *p = myproc();
+  uint before;
 
+  acquire(&kswapdlock);
+  for(;;){
+    while((physPagesCounts.currentFreePagesNo >= PAGES_LOW || swap_avail() == 0) &&
+          ticks - lastscan < WSINTERVAL)
+      sleep(p, &kswapdlock);
+    release(&kswapdlock);
+    if(ticks - lastscan >= WSINTERVAL){
+      wsscan();
+      lastscan = ticks;
+    }
+    // Pages still being written count as free: their frames are
+    // released as the writes complete.
+    before = physPagesCounts.currentFreePagesNo + swap_inflight();
+    while(physPagesCounts.currentFreePagesNo + swap_inflight() < PAGES_HIGH &&
+          swap_avail() > 0)
+      if(swap_page_nowait(p->pgdir) == 0)
+        break;
+    swap_flush(0);
+    if(physPagesCounts.currentFreePagesNo + swap_inflight() <= before){
+      // Nothing could go (every page shared, cached or in use on
+      // another cpu), or writes are still landing: wait a tick
+      // rather than spin.
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+    }
+    acquire(&kswapdlock);
+  }
+}
 
+void
+kswapdinit(void)
+{
+  initlock(&kswapdlock, "kswapd");
+  kswapdproc = create_kernel_process("kswapd", kswapd);
+}
 
+// Called by kalloc() when free memory drops below PAGES_LOW, and
+// by the timer every WSINTERVAL ticks.
+void
+kswapd_wake(void)
+{
+  int held;
 
-
-
-
-
-
-
-
-
-
-
+  // The state test is racy, but a missed wakeup only means the next
+  // kalloc() tries again. kalloc() may run with ptable.lock held.
+  if(kswapdproc == 0 || kswapdproc->state != SLEEPING)
+    return;
+  pushcli();
+  held = holding(&ptable.lock);
+  popcli();
+  if(!held)
+    wakeup(kswapdproc);
+}
@@ -15,6 +15,8 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct run *pcache;          // Free pages cached by kalloc() for this cpu
+  int npcache;                 // Number of pages on pcache
   
   // Cpu-local storage variables; see below	
   struct cpu *cpu;	
@@ -74,6 +76,27 @@ struct freepg {
 
 
 // Per-process state
+// Part of a program's ELF image, read in one page at a time as
+// the process first touches it (see exec() and map_address()).
+struct segment {
+  struct inode *ip;            // Program file, 0 if slot unused
+  uint va;                     // Page-aligned start address
+  uint off;                    // File offset of the first byte
+  uint filesz;                 // Bytes backed by the file
+  uint memsz;                  // Bytes in memory, the rest zero-filled
+};
+
+// A file mapped into the address space by mmap().
+struct vma {
+  uint start;                  // Page-aligned first address
+  uint len;                    // Length in bytes, 0 if slot unused
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // 0 for MAP_ANONYMOUS
+  uint off;                    // File offset of start
+  struct shm *shm;             // Pages of a MAP_ANONYMOUS|MAP_SHARED region
+};
+
 struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
@@ -88,6 +111,16 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct segment seg[NSEG];    // Not yet loaded parts of the program
+  struct vma vma[NVMA];        // Mapped files
+  void (*kentry)(void);        // Body of a kernel thread, else 0
+  uint ranext;                 // Swap-in fault address that would be sequential
+  int rawindow;                // Pages read per swap-in fault
+  int rss;                     // Resident pages, as of the last wsscan()
+  int nswapped;                // Swapped-out pages, likewise
+  int wss;                     // Pages used in the last WSINTERVAL ticks
+  int priority;                // MLFQ level, 0 runs first
+  int ticksleft;               // Of its quantum at that level
   
   	
   //Swap file. must initiate with create swap file	
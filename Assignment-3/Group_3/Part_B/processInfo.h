@@ -0,0 +1,8 @@
+struct processInfo
+{
+    int ppid;
+    int psize;
+    int rss;          // resident pages
+    int nswapped;     // pages in swap
+    int wss;          // pages used in the last sampling interval
+};
@@ -0,0 +1,84 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+// Move data from a child to its parent through a MAP_ANONYMOUS|MAP_SHARED
+// region and through a pipe, and time both.
+// usage: shmtest [kb]
+
+#define PGSIZE 4096
+
+void
+fail(char *msg)
+{
+	printf(1, "shmtest: %s FAILED\n", msg);
+	exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+	int kb = 256, n, i, r, pid, fds[2], t0, t1;
+	char *shm, *buf;
+	volatile int *flag;
+
+	if (argc > 1)
+		kb = atoi(argv[1]);
+	n = kb * 1024;
+
+	// The first page holds a flag, the data follows.
+	shm = mmap(0, n + PGSIZE, PROT_READ | PROT_WRITE,
+	           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == (char*)-1)
+		fail("mmap");
+	flag = (volatile int*)shm;
+
+	t0 = uptime();
+	pid = fork();
+	if (pid < 0)
+		fail("fork");
+	if (pid == 0) {
+		for (i = 0; i < n; i++)
+			shm[PGSIZE + i] = i % 251;
+		*flag = 1;
+		exit();
+	}
+	while (*flag == 0)
+		sleep(1);
+	for (i = 0; i < n; i++)
+		if (shm[PGSIZE + i] != (char)(i % 251))
+			fail("shared data");
+	wait();
+	t1 = uptime();
+	printf(1, "shared memory: %d KB in %d ticks\n", kb, t1 - t0);
+	if (munmap(shm, n + PGSIZE) < 0)
+		fail("munmap");
+
+	if ((buf = malloc(PGSIZE)) == 0)
+		fail("malloc");
+	if (pipe(fds) < 0)
+		fail("pipe");
+	t0 = uptime();
+	pid = fork();
+	if (pid < 0)
+		fail("fork");
+	if (pid == 0) {
+		close(fds[0]);
+		for (i = 0; i < PGSIZE; i++)
+			buf[i] = i % 251;
+		for (i = 0; i < n; i += PGSIZE)
+			write(fds[1], buf, PGSIZE);
+		exit();
+	}
+	close(fds[1]);
+	for (i = 0; i < n; i += r)
+		if ((r = read(fds[0], buf, PGSIZE)) <= 0)
+			fail("pipe read");
+	close(fds[0]);
+	wait();
+	t1 = uptime();
+	printf(1, "pipe: %d KB in %d ticks\n", kb, t1 - t0);
+	printf(1, "shmtest: ok\n");
+	exit();
+}
@@ -0,0 +1,190 @@
+// Object caches for small fixed-size kernel objects.
+//
+// A kmem_cache carves pages from kalloc() into slabs of equal-sized
+// objects, so an object such as a struct pipe no longer costs a
+// whole page. Each slab page starts with a struct slab header that
+// links the free objects inside it; an object finds its slab by
+// rounding its address down to the page boundary.
+//
+// In front of the slabs every cache keeps one magazine per cpu, a
+// small stack of free objects. kmem_cache_alloc() and
+// kmem_cache_free() only take the cache lock when the magazine runs
+// empty or full, and move MAGSIZE/2 objects at a time when they do.
+// Neither path takes kmem.lock except to get or return a slab page.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;           // on cache->partial or cache->full
+  struct slab *prev;
+  void *freelist;              // free objects in this slab
+  int inuse;                   // objects handed out from this slab
+};
+
+#define SLABHDR (((sizeof(struct slab)) + 7) & ~7)
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache[NKCACHE];
+} slabtab;
+
+void
+slabinit(void)
+{
+  initlock(&slabtab.lock, "slabtab");
+}
+
+// Create a cache of objects of the given size.
+// Returns 0 if the object is too large or the table is full.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 7) & ~7;
+  if(size < sizeof(void*) || size > PGSIZE - SLABHDR)
+    return 0;
+
+  acquire(&slabtab.lock);
+  for(c = slabtab.cache; c < &slabtab.cache[NKCACHE]; c++)
+    if(c->size == 0)
+      goto found;
+  release(&slabtab.lock);
+  return 0;
+
+found:
+  memset(c, 0, sizeof(*c));
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  initlock(&c->lock, name);
+  release(&slabtab.lock);
+  return c;
+}
+
+static void
+slab_unlink(struct slab **list, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+slab_link(struct slab **list, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *list;
+  if(*list)
+    (*list)->prev = s;
+  *list = s;
+}
+
+// Take one object from the slabs of c, growing the cache by one
+// page if every slab is full. Caller must hold c->lock.
+static void*
+slab_get(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  int i;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->inuse = 0;
+    s->freelist = 0;
+    obj = (char*)s + SLABHDR;
+    for(i = 0; i < c->perslab; i++, obj += c->size){
+      *(void**)obj = s->freelist;
+      s->freelist = obj;
+    }
+    slab_link(&c->partial, s);
+    c->nslabs++;
+  }
+
+  obj = s->freelist;
+  s->freelist = *(void**)obj;
+  if(++s->inuse == c->perslab){
+    slab_unlink(&c->partial, s);
+    slab_link(&c->full, s);
+  }
+  return obj;
+}
+
+// Return one object to its slab. A slab that becomes empty is
+// given back to kalloc() unless it is the only partial slab left.
+// Caller must hold c->lock.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+  if(s->inuse-- == c->perslab){
+    slab_unlink(&c->full, s);
+    slab_link(&c->partial, s);
+  }
+  *(void**)obj = s->freelist;
+  s->freelist = obj;
+  if(s->inuse == 0 && (s->next || s->prev)){
+    slab_unlink(&c->partial, s);
+    c->nslabs--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate one object from c.
+// Returns 0 if the memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct kmem_magazine *m;
+  void *obj;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slab_get(c)) != 0)
+      m->objs[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = 0;
+  if(m->n > 0)
+    obj = m->objs[--m->n];
+  popcli();
+  return obj;
+}
+
+// Free an object that was returned by kmem_cache_alloc(c).
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct kmem_magazine *m;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slab_put(c, m->objs[--m->n]);
+    release(&c->lock);
+  }
+  m->objs[m->n++] = obj;
+  popcli();
+}
@@ -0,0 +1,19 @@
+#define NKCACHE  16   // maximum number of object caches
+#define MAGSIZE   8   // objects held by each per-cpu magazine
+
+// Per-cpu stack of free objects in front of a cache's slabs.
+struct kmem_magazine {
+  int n;
+  void *objs[MAGSIZE];
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;                   // object size, 0 if this entry is unused
+  int perslab;                 // objects in one slab page
+  int nslabs;                  // slab pages currently held
+  struct spinlock lock;        // protects partial, full and nslabs
+  struct slab *partial;        // slabs with at least one free object
+  struct slab *full;           // slabs with no free object
+  struct kmem_magazine mag[NCPU];
+};
@@ -0,0 +1,350 @@
+// Swap area.
+//
+// mkfs reserves the last SWAPSLOTS pages of the disk for swap and
+// records the extent in the superblock (sb.swapstart, sb.nswap), so
+// swapping never allocates file system blocks and needs no log
+// transaction or bitmap I/O. A slot is one page, i.e. BPP blocks.
+//
+// Slots are tracked only in memory, in the style of Linux 2.4's
+// swap_info_struct (see swap.h): swap_map[] holds the number of
+// PTEs that refer to each slot, there is no free slot below
+// lowest_bit, and new pages are handed out from a cluster of
+// consecutive slots so that pages swapped out together land next to
+// each other on disk.
+//
+// Pages that compress well are kept in memory by zswap.c and never
+// reach the disk. The others are written asynchronously. swap_write() adds a page to a
+// pending request, which grows for as long as the slots follow on
+// from each other, up to SWAPBATCH pages; it is then handed to the
+// disk as one multi-sector command, without going through the
+// buffer cache. The frames stay allocated, and readable through
+// inflight[], until ideintr() reports that the write has landed.
+//
+// A page read back in keeps its slot while swap is less than half
+// full (see kswapcache()). If the page is still clean when it is
+// chosen again, swap_page_from_pte() just points the PTE back at the
+// slot and drops the frame; that is a swap cache hit.
+//
+// If the disk fails a write, the frame stays in inflight[] as the
+// only copy of the slot (stuck[] is set) until the slot is freed.
+// A failed read kills the faulting process; see swapin().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define BPP (PGSIZE / BSIZE)   // blocks per page
+#define SWAP_CLUSTER 8         // slots handed out from one cluster
+#define NSWAPREQ 4             // page requests, pending or on the disk
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;                  // first block of the swap area
+  uint nslots;
+  ushort swap_map[SWAPSLOTS];  // users of each slot, 0 if free
+  uint lowest_bit;             // no free slot below this one
+  uint cluster_next;           // next slot of the current cluster
+  uint cluster_nr;             // slots left in the current cluster
+  struct pagereq req[NSWAPREQ];  // free if npages == 0
+  struct pagereq *pending;     // being filled by swap_write()
+  char *inflight[SWAPSLOTS];   // frame still being written to a slot
+  uchar stuck[SWAPSLOTS];      // its write failed: inflight[] keeps it
+  int ninflight;               // pages queued or on the disk
+} swapinfo;
+
+int numallocblocks = 0;        // slots in use, reported by bstat()
+int swapcachehits;             // clean pages evicted without a write
+int swapcachemisses;           // pages that had to be written
+
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swapinfo.lock, "swap");
+  readsb(dev, &sb);
+  swapinfo.dev = dev;
+  swapinfo.start = sb.swapstart;
+  swapinfo.nslots = sb.nswap;
+  if(swapinfo.nslots > SWAPSLOTS)
+    swapinfo.nslots = SWAPSLOTS;
+  swapinfo.lowest_bit = 0;
+  cprintf("swap: %d slots at block %d\n", swapinfo.nslots, swapinfo.start);
+}
+
+// Find SWAP_CLUSTER free slots in a row and make them the current
+// cluster. Caller must hold swapinfo.lock.
+static int
+newcluster(void)
+{
+  uint i, run;
+
+  run = 0;
+  for(i = swapinfo.lowest_bit; i < swapinfo.nslots; i++){
+    if(swapinfo.swap_map[i]){
+      run = 0;
+      continue;
+    }
+    if(++run == SWAP_CLUSTER){
+      swapinfo.cluster_next = i - (SWAP_CLUSTER - 1);
+      swapinfo.cluster_nr = SWAP_CLUSTER;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Allocate a swap slot with one user.
+// Returns -1 if the swap area is full.
+int
+swap_alloc(void)
+{
+  uint i;
+
+  acquire(&swapinfo.lock);
+  if(swapinfo.cluster_nr == 0 || swapinfo.swap_map[swapinfo.cluster_next])
+    if(newcluster() < 0)
+      swapinfo.cluster_nr = 0;
+  if(swapinfo.cluster_nr > 0){
+    i = swapinfo.cluster_next++;
+    swapinfo.cluster_nr--;
+    goto found;
+  }
+  // Too fragmented for a whole cluster: take any free slot.
+  for(i = swapinfo.lowest_bit; i < swapinfo.nslots; i++)
+    if(swapinfo.swap_map[i] == 0)
+      goto found;
+  release(&swapinfo.lock);
+  return -1;
+
+found:
+  swapinfo.swap_map[i] = 1;
+  if(i == swapinfo.lowest_bit)
+    swapinfo.lowest_bit++;
+  numallocblocks++;
+  release(&swapinfo.lock);
+  return i;
+}
+
+// Another PTE refers to slot, e.g. after fork().
+void
+swap_dup(uint slot)
+{
+  acquire(&swapinfo.lock);
+  if(slot >= swapinfo.nslots || swapinfo.swap_map[slot] == 0)
+    panic("swap_dup");
+  swapinfo.swap_map[slot]++;
+  release(&swapinfo.lock);
+}
+
+// Drop one user of slot; the slot is free once it has none.
+void
+swap_free(uint slot)
+{
+  char *pg = 0;
+
+  acquire(&swapinfo.lock);
+  if(slot >= swapinfo.nslots || swapinfo.swap_map[slot] == 0)
+    panic("swap_free");
+  if(--swapinfo.swap_map[slot] == 0){
+    zswap_invalidate(slot);
+    if(swapinfo.stuck[slot]){
+      pg = swapinfo.inflight[slot];
+      swapinfo.inflight[slot] = 0;
+      swapinfo.stuck[slot] = 0;
+    }
+    if(slot < swapinfo.lowest_bit)
+      swapinfo.lowest_bit = slot;
+    numallocblocks--;
+  }
+  release(&swapinfo.lock);
+  if(pg)
+    kfree(pg);
+}
+
+// Number of pages written but not yet on disk. Their frames will
+// be free soon.
+int
+swap_inflight(void)
+{
+  return swapinfo.ninflight;
+}
+
+// Whether a page read from swap may keep its slot.
+int
+swap_cacheable(void)
+{
+  return swap_avail() > swapinfo.nslots / 2;
+}
+
+// Number of free slots.
+int
+swap_avail(void)
+{
+  return swapinfo.nslots - numallocblocks;
+}
+
+// Called by ideintr() when the write r has landed: the frames can
+// go now. If the disk failed it, a frame whose slot is still in use
+// stays, as the slot's data.
+static void
+swap_written(struct pagereq *r)
+{
+  uint slot;
+  int i;
+
+  if(r->error)
+    cprintf("swap: write of %d pages at block %d failed\n",
+            r->npages, r->blockno);
+  acquire(&swapinfo.lock);
+  slot = (r->blockno - swapinfo.start) / BPP;
+  for(i = 0; i < r->npages; i++, slot++){
+    // The slot may have been freed and written again since.
+    if(swapinfo.inflight[slot] == r->pages[i]){
+      if(r->error){
+        swapinfo.stuck[slot] = 1;
+        r->pages[i] = 0;
+      } else
+        swapinfo.inflight[slot] = 0;
+    }
+    swapinfo.ninflight--;
+  }
+  release(&swapinfo.lock);
+
+  for(i = 0; i < r->npages; i++)
+    if(r->pages[i])
+      kfree(r->pages[i]);
+
+  acquire(&swapinfo.lock);
+  r->npages = 0;
+  wakeup(&swapinfo);
+  release(&swapinfo.lock);
+}
+
+// Write the page pg to slot. The write may not have started when
+// swap_write() returns; the frame belongs to the swap code from now
+// on and is freed once it is on disk.
+void
+swap_write(uint slot, char *pg)
+{
+  struct pagereq *r;
+
+  if(zswap_store(slot, pg) == 0){
+    kfree(pg);
+    return;
+  }
+
+  acquire(&swapinfo.lock);
+  swapinfo.inflight[slot] = pg;
+  swapinfo.ninflight++;
+
+  r = swapinfo.pending;
+  if(r && (r->npages == SWAPBATCH ||
+           r->blockno + r->npages*BPP != swapinfo.start + slot*BPP)){
+    // Not adjacent: send what we have and start over. idepages()
+    // takes idelock, which ideintr() holds when it calls
+    // swap_written(), so swapinfo.lock must not be held.
+    swapinfo.pending = 0;
+    release(&swapinfo.lock);
+    idepages(r);
+    acquire(&swapinfo.lock);
+  }
+
+  while((r = swapinfo.pending) == 0){
+    for(r = swapinfo.req; r < &swapinfo.req[NSWAPREQ]; r++)
+      if(r->npages == 0){
+        r->write = 1;
+        r->dev = swapinfo.dev;
+        r->blockno = swapinfo.start + slot*BPP;
+        r->done = swap_written;
+        swapinfo.pending = r;
+        break;
+      }
+    if(swapinfo.pending == 0)
+      sleep(&swapinfo, &swapinfo.lock);
+  }
+  r->pages[r->npages++] = pg;
+  release(&swapinfo.lock);
+}
+
+// Send the pending write to the disk. If wait is set, also wait
+// until every page written so far is on disk and its frame freed.
+void
+swap_flush(int wait)
+{
+  struct pagereq *r;
+
+  acquire(&swapinfo.lock);
+  r = swapinfo.pending;
+  swapinfo.pending = 0;
+  release(&swapinfo.lock);
+  if(r)
+    idepages(r);
+
+  if(!wait)
+    return;
+  acquire(&swapinfo.lock);
+  while(swapinfo.ninflight > 0)
+    sleep(&swapinfo, &swapinfo.lock);
+  release(&swapinfo.lock);
+}
+
+// Read the n (at most SWAPBATCH) consecutive slots starting at slot
+// into the pages pgs[0..n-1], with as few disk requests as possible.
+// Returns 0, or -1 if the disk failed a read.
+int
+swap_read_pages(uint slot, char **pgs, int n)
+{
+  struct pagereq r;
+  char *src;
+  int i, got, err;
+
+  r.write = 0;
+  r.dev = swapinfo.dev;
+  r.done = 0;
+  r.npages = 0;
+  err = 0;
+  for(i = 0; i <= n; i++){
+    got = 0;
+    if(i < n && zswap_load(slot+i, pgs[i]) == 0)
+      got = 1;
+    else if(i < n){
+      acquire(&swapinfo.lock);
+      // Still on its way out: the frame has the data.
+      if((src = swapinfo.inflight[slot+i]) != 0){
+        memmove(pgs[i], src, PGSIZE);
+        got = 1;
+      }
+      release(&swapinfo.lock);
+    }
+    if(i == n || got){
+      if(r.npages > 0){
+        idepages(&r);
+        if(r.error){
+          cprintf("swap: read of %d pages at block %d failed\n",
+                  r.npages, r.blockno);
+          err = -1;
+        }
+      }
+      r.npages = 0;
+      continue;
+    }
+    if(r.npages == 0)
+      r.blockno = swapinfo.start + (slot+i)*BPP;
+    r.pages[r.npages++] = pgs[i];
+  }
+  return err;
+}
+
+// Read slot into the page pg. Returns 0, or -1 on a disk error.
+int
+swap_read(uint slot, char *pg)
+{
+  return swap_read_pages(slot, &pg, 1);
+}
@@ -6,6 +6,8 @@
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "fcntl.h"
+#include "paging.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -21,6 +23,8 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(prefault(addr, 4, 0) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -33,12 +37,18 @@ fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
   struct proc *curproc = myproc();
+  struct vma *v;
 
-  if(addr >= curproc->sz)
+  if(addr < curproc->sz)
+    ep = (char*)curproc->sz;
+  else if((v = vmarange(curproc, addr, 1, 0)) != 0 && !(v->flags & MAP_SHARED))
+    ep = (char*)(v->start + v->len);
+  else
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) && prefault((uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
@@ -53,26 +63,45 @@ argint(int n, int *ip)
 }
 
 // Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+// to a block of memory of size bytes, which the kernel may read, or
+// also write if write is set.  Check that the block lies within the
+// process memory or in one of its mappings, and page it in.
+static int
+argbuf(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
 
-  if(argint(n, &i) < 0)
+  if(argint(n, &i) < 0 || size < 0)
+    return -1;
+  if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) &&
+     vmarange(curproc, i, size, write) == 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(prefault(i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// A block the kernel writes to, e.g. the buffer of read().
+int
+argptr(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 1);
+}
+
+// A block the kernel only reads, e.g. the buffer of write(), which
+// may be in a read-only mapping.
+int
+argrdptr(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 0);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (Strings in MAP_SHARED mappings are refused, so the string can't
+// change between this check and being used by the kernel.)
 int
 argstr(int n, char **pp)
 {
@@ -105,6 +134,11 @@ extern int sys_write(void);
 extern int sys_uptime(void);
 extern int sys_bstat(void);
 extern int sys_swap(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_scstat(void);
+extern int sys_getProcInfo(void);
+extern int sys_getvmstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -130,6 +164,11 @@ static int (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_bstat]   sys_bstat,
 [SYS_swap]    sys_swap,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_scstat]  sys_scstat,
+[SYS_getProcInfo] sys_getProcInfo,
+[SYS_getvmstat] sys_getvmstat,
 };
 
 void
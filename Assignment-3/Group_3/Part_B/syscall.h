@@ -22,3 +22,8 @@
 #define SYS_close  21
 #define SYS_bstat  22
 #define SYS_swap   23
+#define SYS_mmap   24
+#define SYS_munmap 25
+#define SYS_scstat 26
+#define SYS_getProcInfo 27
+#define SYS_getvmstat 28
@@ -19,31 +19,7 @@
 #include "memlayout.h"
 
 extern int numallocblocks;
-
-// Return the address of the PTE in page table pgdir
-// that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
-static pte_t *
-walkpgdir(pde_t *pgdir, const void *va, int alloc)
-{
-  pde_t *pde;
-  pte_t *pgtab;
-
-  pde = &pgdir[PDX(va)];
-  if(*pde & PTE_P){
-    pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
-  } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
-    // The permissions here are overly generous, but they can
-    // be further restricted by the permissions in the page table
-    // entries, if necessary.
-    *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
-  }
-  return &pgtab[PTX(va)];
-}
+extern int swapcachehits, swapcachemisses;
 
 
 // Fetch the nth word-sized system call argument as a file descriptor
@@ -115,7 +91,7 @@ sys_write(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argrdptr(1, &p, n) < 0)
     return -1;
   return filewrite(f, p, n);
 }
@@ -483,6 +459,22 @@ sys_bstat(void)
 	return numallocblocks;
 }
 
+/* scstat(&hits, &misses): swap cache counters. A hit is a page
+   evicted without a write because swap still had a clean copy.
+ */
+int
+sys_scstat(void)
+{
+  int *hits, *misses;
+
+  if(argptr(0, (void*)&hits, sizeof(*hits)) < 0 ||
+     argptr(1, (void*)&misses, sizeof(*misses)) < 0)
+    return -1;
+  *hits = swapcachehits;
+  *misses = swapcachemisses;
+  return 0;
+}
+
 /* swap system call handler.
  */
 
@@ -499,8 +491,39 @@ sys_swap(void)
   pde_t *pgdir=currentProcess->pgdir;
   pte_t *pte=walkpgdir(pgdir,(char*)addr,1);
   if(*pte & PTE_P){
-    swap_page_from_pte(pte);
+    if(swap_page_from_pte(pte) < 0)
+      return -1;
+    swap_flush(1);
   }
 
   return 0;
 }
+
+// Map a file, or zeroed memory with MAP_ANONYMOUS:
+// mmap(addr, len, prot, flags, fd, off).
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, off;
+  struct file *f;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  f = 0;
+  if(!(flags & MAP_ANONYMOUS) && argfd(4, 0, &f) < 0)
+    return -1;
+  if(len <= 0 || off < 0)
+    return -1;
+  return mmap(addr, len, prot, flags, f, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return munmap(addr, len);
+}
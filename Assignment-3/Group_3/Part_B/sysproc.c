@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "processInfo.h"
+#include "vmstat.h"
 
 int
 sys_fork(void)
@@ -89,3 +91,30 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// getProcInfo(pid, &info): memory use of process pid, as of the
+// last working set sample.
+int
+sys_getProcInfo(void)
+{
+  int pid;
+  struct processInfo *info;
+
+  if(argint(0, &pid) < 0 || argptr(1, (void*)&info, sizeof(*info)) < 0)
+    return -1;
+  return getProcInfo(pid, info);
+}
+
+// getvmstat(st, n): paging statistics of the first n cpus.
+// Returns the number of cpus.
+int
+sys_getvmstat(void)
+{
+  struct vmstat *st;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > NCPU ||
+     argptr(0, (void*)&st, n*sizeof(*st)) < 0)
+    return -1;
+  return getvmstat(st, n);
+}
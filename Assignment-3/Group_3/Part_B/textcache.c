@@ -0,0 +1,148 @@
+// Cache of program pages shared by every process running a binary.
+//
+// When map_address() reads a page of a program that lies wholly in
+// the file part of an ELF segment, it hands the page to this cache.
+// Later faults on the same page of the same inode, from any process,
+// get the cached frame mapped copy-on-write instead of reading the
+// file again, so concurrent copies of sh or cat share their text.
+//
+// The cache holds one kalloc() reference on every page it keeps and
+// each mapping holds another. An entry is dropped when its part of
+// the file is written or truncated, when its slot is needed for another page, or
+// when memory runs short (textcache_reclaim()).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct textpage {
+  uint dev;
+  uint inum;                   // 0 if slot unused
+  uint off;                    // file offset of the page
+  char *page;
+};
+
+struct {
+  struct spinlock lock;
+  struct textpage ent[NTEXTPG];
+  int n;                       // slots in use
+  int hand;                    // next slot to consider for replacement
+} textcache;
+
+void
+textcacheinit(void)
+{
+  initlock(&textcache.lock, "textcache");
+}
+
+// Return the cached page of ip at file offset off with a
+// reference taken for the caller, or 0 if it is not cached.
+char*
+textcache_get(struct inode *ip, uint off)
+{
+  struct textpage *t;
+  char *page = 0;
+
+  acquire(&textcache.lock);
+  for(t = textcache.ent; t < &textcache.ent[NTEXTPG]; t++){
+    if(t->inum == ip->inum && t->dev == ip->dev && t->off == off){
+      page = t->page;
+      kdup(page);
+      break;
+    }
+  }
+  release(&textcache.lock);
+  return page;
+}
+
+static void
+textcache_drop(struct textpage *t)
+{
+  kfree(t->page);
+  t->inum = 0;
+  t->page = 0;
+  textcache.n--;
+}
+
+// Offer page, holding the contents of ip at file offset off, to the
+// cache. The caller keeps its own reference and must map the page
+// read-only from now on.
+void
+textcache_put(struct inode *ip, uint off, char *page)
+{
+  struct textpage *t, *victim;
+  int i;
+
+  acquire(&textcache.lock);
+  victim = 0;
+  for(t = textcache.ent; t < &textcache.ent[NTEXTPG]; t++){
+    if(t->inum == ip->inum && t->dev == ip->dev && t->off == off){
+      release(&textcache.lock);        // raced with another fault
+      return;
+    }
+    if(t->inum == 0 && victim == 0)
+      victim = t;
+  }
+  if(victim == 0){
+    // Prefer a page nobody has mapped; otherwise take the next one
+    // round the table. Processes using it keep their reference.
+    for(i = 0; i < NTEXTPG; i++){
+      t = &textcache.ent[(textcache.hand + i) % NTEXTPG];
+      if(krefcount(t->page) == 1)
+        break;
+    }
+    if(i == NTEXTPG)
+      t = &textcache.ent[textcache.hand];
+    textcache.hand = (t - textcache.ent + 1) % NTEXTPG;
+    textcache_drop(t);
+    victim = t;
+  }
+  kdup(page);
+  victim->dev = ip->dev;
+  victim->inum = ip->inum;
+  victim->off = off;
+  victim->page = page;
+  textcache.n++;
+  release(&textcache.lock);
+}
+
+// Forget the cached pages of ip that hold any of the n bytes at
+// off; their contents are changing.
+void
+textcache_inval(struct inode *ip, uint off, uint n)
+{
+  struct textpage *t;
+
+  if(textcache.n == 0 || n == 0)
+    return;
+  acquire(&textcache.lock);
+  for(t = textcache.ent; t < &textcache.ent[NTEXTPG]; t++)
+    if(t->inum == ip->inum && t->dev == ip->dev &&
+       t->off < off + n && off < t->off + PGSIZE)
+      textcache_drop(t);
+  release(&textcache.lock);
+}
+
+// Free the cached pages that no process has mapped.
+// Returns the number of pages freed.
+int
+textcache_reclaim(void)
+{
+  struct textpage *t;
+  int n = 0;
+
+  acquire(&textcache.lock);
+  for(t = textcache.ent; t < &textcache.ent[NTEXTPG]; t++){
+    if(t->inum && krefcount(t->page) == 1){
+      textcache_drop(t);
+      n++;
+    }
+  }
+  release(&textcache.lock);
+  return n;
+}
@@ -8,6 +8,7 @@
 #include "traps.h"
 #include "spinlock.h"
 #include "paging.h"
+#include "vmstat.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -37,6 +38,8 @@ idtinit(void)
 void
 trap(struct trapframe *tf)
 {
+  uint64 start;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -49,6 +52,26 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_PGFLT:
+    if(tf->err & FEC_PR){
+      // The page is there but the access was not allowed. A write to
+      // a copy-on-write page just needs a private copy.
+      start = rdtsc();
+      if((tf->err & FEC_WR) && myproc() &&
+         cowfault(myproc()->pgdir, rcr2()) == 0){
+        vmstat_fault(VM_COWFLT, start);
+        break;
+      }
+      if(myproc() == 0 || (tf->cs&3) == 0){
+        cprintf("protection fault from cpu %d eip %x (cr2=0x%x)\n",
+                cpuid(), tf->eip, rcr2());
+        panic("trap");
+      }
+      cprintf("pid %d %s: protection fault err %d on cpu %d "
+              "eip 0x%x addr 0x%x--kill proc\n",
+              myproc()->pid, myproc()->name, tf->err, cpuid(), tf->eip, rcr2());
+      myproc()->killed = 1;
+      break;
+    }
   	handle_pgfault();
   	break;
   case T_IRQ0 + IRQ_TIMER:
@@ -57,6 +80,8 @@ trap(struct trapframe *tf)
       ticks++;
       wakeup(&ticks);
       release(&tickslock);
+      if(ticks % WSINTERVAL == 0)
+        kswapd_wake();
     }
     lapiceoi();
     break;
@@ -107,7 +132,7 @@ trap(struct trapframe *tf)
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && timeslice())
     yield();
 
   // Check if the process has been killed since we yielded
@@ -1,4 +1,6 @@
 struct stat;
+struct processInfo;
+struct vmstat;
 struct rtcdate;
 
 // system calls
@@ -25,6 +27,11 @@ int sleep(int);
 int uptime(void);
 int bstat(void);
 int swap(void*);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int scstat(int*, int*);
+int getProcInfo(int, struct processInfo*);
+int getvmstat(struct vmstat*, int);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -8,9 +8,13 @@
 #include "elf.h"
 #include "paging.h"
 #include "fs.h"
+#include "spinlock.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+static struct spinlock clocklock;  // protects clockhand
+static uint clockhand;             // next frame select_a_victim() looks at
+int nwsover;                       // processes above their working set
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -34,7 +38,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -44,10 +48,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
+    // kalloc_zeroed() makes sure all those PTE_P bits are zero.
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
       return 0;
-    // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -123,9 +126,9 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
+  kmarkpgdir((char*)pgdir);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
@@ -144,6 +147,7 @@ kvmalloc(void)
 {
   kpgdir = setupkvm();
   switchkvm();
+  initlock(&clocklock, "clock");
 }
 
 // Switch h/w page table register to the kernel-only page table,
@@ -188,9 +192,9 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
+  krmap(mem, pgdir, 0);
   memmove(mem, init, sz);
 }
 
@@ -234,19 +238,19 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   a = PGROUNDUP(oldsz);
 
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       //cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       //cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
       kfree(mem);
       return 0;
     }
+    krmap(mem, pgdir, a);
   }
   return newsz;
 }
@@ -274,7 +278,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
     else if(*pte & PTE_SWAPPED){
         uint block_id= (*pte)>>12;
-        bfree_page(ROOTDEV,block_id);
+        swap_free(block_id);
+        *pte = 0;
       }
 
     else if((*pte & PTE_P) != 0){
@@ -299,6 +304,7 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  pgdir_drain(pgdir);
   deallocuvm(pgdir, KERNBASE, 0);
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
@@ -309,74 +315,104 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
-// Select a page-table entry which is mapped
-// but not accessed. Notice that the user memory
-// is mapped between 0...KERNBASE.
-
-/* ********xv7*************
-i) in the kmem.freelist, find a page whose access bit is not setting
-ii) if (i) is unable to find any such page, randomly reset access bit
-    of 10% of the allocated pages and call select_a_victim() again
-*/
-
+// Select a page to swap out, from any process.
+//
+// A clock hand sweeps over physical frames. Each user page that has
+// a single user knows its mapping through the reverse map kept by
+// kalloc.c (krmap()), so the hand can look at the PTE directly. A
+// page whose access bit is set gets a second chance: the bit is
+// cleared and the hand moves on. The hand is kept across calls, so
+// a victim costs a few frames on average instead of a sweep of the
+// whole address space. Each page directory is pinned while the hand
+// looks at it (see pgdir_pin()), so it cannot be freed and its
+// process cannot run on another cpu and cache the PTE in its TLB;
+// pages of a process running on another cpu are skipped.
+// While wsscan() has found processes with more pages resident than
+// their working set, the hand first looks only at their pages.
+// Returns the victim's PTE, or 0 if no page can be swapped out. The
+// victim's page directory is returned pinned in *victim; the caller
+// must pgdir_unpin() it once the PTE has been changed.
 pte_t*
-select_a_victim(pde_t *pgdir)
+select_a_victim(pde_t *pgdir, pde_t **victim)
 {
   pte_t *pte;
-  for(long i=4096; i<KERNBASE;i+=PGSIZE){    //for all pages in the user virtual space
-  
-    if((pte=walkpgdir(pgdir,(char*)i,0))!= 0) //if mapping exists (0 as 3rd argument as we dont want to create mapping if does not exists)
-		  {    
-
-           if(*pte & PTE_P) //if not dirty, or (present and access bit not set)  --- conditions needs to be checked
-           {   if(*pte & ~PTE_A)             //access bit is NOT set.
-               {
-                 return pte;
-               }
-           }
+  pde_t *pd;
+  uint n, pfn, va;
+  int all;
+
+  acquire(&clocklock);
+  for(all = nwsover == 0; all < 2; all++){
+    // Two turns: the first may only clear access bits.
+    for(n = 0; n < 2 * (PHYSTOP / PGSIZE); n++){
+      pfn = clockhand;
+      clockhand = (clockhand + 1) % (PHYSTOP / PGSIZE);
+      if(!krmapget(pfn, &pd, &va))
+        continue;
+      if(!all && !kpgdirisover(pd))
+        continue;
+      if(!pgdir_pin(pd))
+        continue;
+      pte = walkpgdir(pd, (char*)va, 0);
+      if(pte == 0 || (*pte & PTE_P) == 0 || PTE_ADDR(*pte) != pfn * PGSIZE){
+        pgdir_unpin(pd);
+        continue;
       }
-      else{
-
-        cprintf("walkpgdir failed \n ");
+      if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        pgdir_unpin(pd);
+        continue;
       }
-	}
-
+      release(&clocklock);
+      *victim = pd;
+      return pte;
+    }
+  }
+  release(&clocklock);
   return 0;
 }
 
-// Clear access bit of a random pte.
-void
-clearaccessbit(pde_t *pgdir)
-{ pte_t *pte;
-  int count=0;
-  for(long i=4096;i<KERNBASE;i+=PGSIZE){
-      if((pte=walkpgdir(pgdir,(char*)i,0))!= 0){
-        cprintf("walkpkgdir mei");
-        if((*pte & PTE_P) & (*pte & PTE_A)){
-            *pte &= ~PTE_A;
-            count=count+1;
-            if(count<103){
-              cprintf("103 se kam hai");
-            }
-            else{
-              cprintf("103 se zyaada ho gya");
-            }
+// Sample the user part of pgdir for wsscan(): count resident pages
+// in *rss and swapped-out ones in *nswapped, and return how many
+// resident pages were accessed since the last sample, clearing
+// their access bits. The process must not be running. Another cpu
+// may be swapping one of its pages out meanwhile, so the bits are
+// cleared atomically.
+int
+wsample(pde_t *pgdir, int *rss, int *nswapped)
+{
+  pde_t pde;
+  pte_t *pgtab, pte;
+  int i, j, accessed;
+
+  *rss = *nswapped = accessed = 0;
+  for(i = 0; i < PDX(KERNBASE); i++){
+    pde = pgdir[i];
+    if(!(pde & PTE_P))
+      continue;
+    pgtab = (pte_t*)P2V(PTE_ADDR(pde));
+    for(j = 0; j < NPTENTRIES; j++){
+      pte = pgtab[j];
+      if(pte & PTE_P){
+        (*rss)++;
+        if(pte & PTE_A){
+          accessed++;
+          __sync_fetch_and_and(&pgtab[j], ~PTE_A);
         }
+      } else if(pte & PTE_SWAPPED)
+        (*nswapped)++;
     }
-  
-    if(count==103)   //10% of the 1024 pages cleared
-      return;
   }
+  return accessed;
 }
 
-// return the disk block-id, if the virtual address
+// return the swap slot, if the virtual address
 // was swapped, -1 otherwise.
 int
 getswappedblk(pde_t *pgdir, uint va)
 {
   //***************xv7**************
   pte_t *pte= walkpgdir(pgdir,(char*)va,0);
-  //first 20 bits contain block-id, extract them from *pte
+  //first 20 bits contain the slot, extract them from *pte
   int block_id= (*pte)>>12;
   return block_id;
 }
@@ -396,41 +432,43 @@ clearpteu(pde_t *pgdir, char *uva)
 
 // Given a parent process's page table, create a copy
 // of it for a child.
+// Pages are not copied: parent and child share each physical page
+// read-only with PTE_COW set, and whoever writes first gets a private
+// copy in cowfault(). Build with 'make NOCOW=1' to copy eagerly
+// instead, e.g. to compare fork latency with forkbench.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
+#ifdef NOCOW
   char *mem;
+#endif
   if((d = setupkvm()) == 0)
     return 0;
   // cprintf("process size is: %d",sz);
   for(i = 0; i < sz; i += PGSIZE){
     // cprintf("i is :%d",i);
+    // Pages of a lazily grown heap that were never touched have no
+    // mapping yet; the child will fault them in itself.
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+      continue;
+    if((*pte & (PTE_P|PTE_SWAPPED)) == 0)
+      continue;
 
     if(*pte & PTE_SWAPPED){
-    //  *********************xv7******************
-    //cprintf("page was swapped\n");
-      if((mem = kalloc()) == 0)
-      {
-        swap_page(pgdir);
-        mem=kalloc();
-      }
-      int blockid=getswappedblk(pgdir,i);      //disk id where the page was swapped
-      read_page_from_disk(ROOTDEV,mem,blockid);
-
-      *pte=V2P(mem) | PTE_W | PTE_U | PTE_P;
-      *pte &= ~PTE_SWAPPED;
-      lcr3(V2P(pgdir));
-
-      bfree_page(ROOTDEV,blockid);
-
-      //panic("copyuvm: page not present");
+      // The child shares the swap slot; whichever process faults
+      // the page back in first reads it and drops its reference.
+      pte_t *npte;
+      if((npte = walkpgdir(d, (void *) i, 1)) == 0)
+        goto bad;
+      swap_dup(getswappedblk(pgdir, i));
+      *npte = *pte;
+      continue;
     }
     //  cprintf("page was not swapped\n");
+#ifdef NOCOW
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
     if((mem = kalloc()) == 0)
@@ -446,12 +484,62 @@ copyuvm(pde_t *pgdir, uint sz)
     memmove(mem, (char*)P2V(pa), PGSIZE);
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
       goto bad;
+    krmap(mem, d, i);
+#else
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+    pa = PTE_ADDR(*pte);
+    flags = PTE_FLAGS(*pte);
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
+      goto bad;
+    kdup(P2V(pa));
+#endif
 }
+  // The parent may still have writable translations cached.
+  lcr3(V2P(pgdir));
   //cprintf("exiting from copyuvm");
   return d;
 
 bad:
   freevm(d);
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
+// Handle a write fault at va on a page shared copy-on-write: the
+// last user takes the page over, anyone else gets a private copy.
+// Returns -1 if va is not a copy-on-write page, or memory and swap
+// are both full.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  uint pa;
+  char *mem;
+
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (void*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+
+  pa = PTE_ADDR(*pte);
+  if(krefcount(P2V(pa)) == 1){
+    *pte = (*pte | PTE_W) & ~PTE_COW;
+    krmap(P2V(pa), pgdir, PGROUNDDOWN(va));
+  } else {
+    if((mem = kalloc()) == 0){
+      // Make room and let the write fault again; the victim may
+      // well be this very page. With swap full too, give up.
+      if(swap_page(pgdir) == 0)
+        return -1;
+      return 0;
+    }
+    memmove(mem, (char*)P2V(pa), PGSIZE);
+    *pte = V2P(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+    krmap(mem, pgdir, PGROUNDDOWN(va));
+    kfree(P2V(pa));
+  }
+  lcr3(V2P(pgdir));
   return 0;
 }
 
@@ -486,10 +574,18 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
+  pte_t *pte;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    // The kernel writes through its own mapping, so break any
+    // copy-on-write sharing by hand. cowfault() may only make room
+    // the first time, so go on until the page is private.
+    while((pte = walkpgdir(pgdir, (char*)va0, 0)) != 0 &&
+          (*pte & (PTE_P|PTE_COW)) == (PTE_P|PTE_COW))
+      if(cowfault(pgdir, va0) < 0)
+        return -1;
     pa0 = uva2ka(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
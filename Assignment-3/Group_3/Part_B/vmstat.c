@@ -0,0 +1,51 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "vmstat.h"
+
+// Print the kernel's paging counters for each cpu, and the fault
+// latency histograms summed over all cpus.
+// usage: vmstat
+
+char *names[NVMSTAT] = { "minflt", "majflt", "cowflt", "swpin", "swpout", "evict" };
+
+struct vmstat st[NCPU];
+
+int
+main(int argc, char *argv[])
+{
+	int i, j, c, n;
+	uint sum;
+
+	if((n = getvmstat(st, NCPU)) < 0){
+		printf(2, "vmstat: getvmstat failed\n");
+		exit();
+	}
+	if(n > NCPU)
+		n = NCPU;
+
+	printf(1, "cpu");
+	for(i = 0; i < NVMSTAT; i++)
+		printf(1, "\t%s", names[i]);
+	printf(1, "\n");
+	for(c = 0; c < n; c++){
+		printf(1, "%d", c);
+		for(i = 0; i < NVMSTAT; i++)
+			printf(1, "\t%d", st[c].count[i]);
+		printf(1, "\n");
+	}
+
+	// Bucket j holds faults that took 2^j to 2^(j+1)-1 cycles.
+	for(i = 0; i < NFLTCLASS; i++){
+		printf(1, "\n%s latency (log2 cycles: faults)\n", names[i]);
+		for(j = 0; j < NVMHIST; j++){
+			sum = 0;
+			for(c = 0; c < n; c++)
+				sum += st[c].hist[i][j];
+			if(sum)
+				printf(1, "  %d: %d\n", j, sum);
+		}
+	}
+	exit();
+}
@@ -0,0 +1,18 @@
+// Paging event counters, kept per cpu by pgstat.c and read with
+// getvmstat().
+
+#define VM_MINFLT   0   // faults served without I/O
+#define VM_MAJFLT   1   // faults that read a file or swap
+#define VM_COWFLT   2   // copy-on-write faults
+#define VM_SWPIN    3   // pages brought back from swap
+#define VM_SWPOUT   4   // pages written to swap
+#define VM_EVICT    5   // pages taken away, written or not
+#define NVMSTAT     6
+
+#define NFLTCLASS   3   // VM_MINFLT, VM_MAJFLT and VM_COWFLT
+#define NVMHIST    32   // bucket i: faults that took 2^i to 2^(i+1)-1 cycles
+
+struct vmstat {
+  uint count[NVMSTAT];
+  uint hist[NFLTCLASS][NVMHIST];
+};
@@ -130,6 +130,14 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -0,0 +1,240 @@
+// Compressed swap pool, in the style of Linux's zswap.
+//
+// swap_write() first offers each page to zswap_store(), which
+// compresses it with a small LZ77 coder and keeps the result in
+// memory under the page's swap slot. Only pages that do not compress
+// to ZMAXLEN bytes, or that do not fit in the pool, go to the disk.
+// swap_read_pages() asks zswap_load() before the disk, and
+// swap_free() drops the entry once the slot has no users left.
+//
+// Compressed pages live in slab caches of power-of-two sizes, so the
+// pool is carved from kalloc() pages; it may hold at most ZSWAPPAGES
+// of them.
+//
+// The compressed format is a sequence of items. A tag byte below
+// 0x80 is followed by tag+1 literal bytes. Any other tag is a match
+// of (tag & 0x7f) + MINMATCH bytes, copied from the output a 2-byte
+// distance back.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+#define MINMATCH 3
+#define MAXMATCH (0x7f + MINMATCH)
+#define MAXLIT   0x80
+#define ZMAXLEN  1024           // larger results go to disk
+#define ZMINCLS  64             // smallest size class
+#define NZCLASS  5              // 64, 128, ..., ZMAXLEN
+#define HASHBITS 10
+
+struct zentry {
+  char *data;                   // 0 if the slot is not in the pool
+  ushort len;
+  uchar cls;
+};
+
+struct {
+  struct spinlock lock;         // protects everything below
+  struct kmem_cache *cache[NZCLASS];
+  struct zentry ent[SWAPSLOTS];
+  ushort hash[1<<HASHBITS];     // 1 + last position of each 3-byte hash
+  uchar buf[ZMAXLEN];           // compressor output
+} zswap;
+
+void
+zswapinit(void)
+{
+  static char *names[NZCLASS] = {
+    "zswap64", "zswap128", "zswap256", "zswap512", "zswap1024"
+  };
+  int i;
+
+  initlock(&zswap.lock, "zswap");
+  for(i = 0; i < NZCLASS; i++)
+    if((zswap.cache[i] = kmem_cache_create(names[i], ZMINCLS << i)) == 0)
+      panic("zswapinit");
+}
+
+static uint
+hash3(uchar *p)
+{
+  return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761U) >> (32 - HASHBITS);
+}
+
+// Append the literals src[0..n-1] to dst at *op.
+// Returns -1 if they do not fit in max bytes.
+static int
+putlits(uchar *dst, int *op, int max, uchar *src, int n)
+{
+  int k;
+
+  while(n > 0){
+    k = n < MAXLIT ? n : MAXLIT;
+    if(*op + 1 + k > max)
+      return -1;
+    dst[(*op)++] = k - 1;
+    memmove(dst + *op, src, k);
+    *op += k;
+    src += k;
+    n -= k;
+  }
+  return 0;
+}
+
+// Compress the page src into dst. Returns the compressed length,
+// or -1 if it would exceed max. Caller must hold zswap.lock.
+static int
+compress(uchar *src, uchar *dst, int max)
+{
+  int i, lit, op, cand, len;
+  uint h;
+
+  memset(zswap.hash, 0, sizeof(zswap.hash));
+  i = lit = op = 0;
+  while(i + MINMATCH <= PGSIZE){
+    h = hash3(src + i);
+    cand = zswap.hash[h] - 1;
+    zswap.hash[h] = i + 1;
+    if(cand < 0 || src[cand] != src[i] || src[cand+1] != src[i+1] ||
+       src[cand+2] != src[i+2]){
+      i++;
+      continue;
+    }
+    len = MINMATCH;
+    while(i + len < PGSIZE && len < MAXMATCH && src[cand+len] == src[i+len])
+      len++;
+    if(putlits(dst, &op, max, src + lit, i - lit) < 0 || op + 3 > max)
+      return -1;
+    dst[op++] = 0x80 | (len - MINMATCH);
+    dst[op++] = (i - cand) & 0xff;
+    dst[op++] = (i - cand) >> 8;
+    i += len;
+    lit = i;
+  }
+  if(putlits(dst, &op, max, src + lit, PGSIZE - lit) < 0)
+    return -1;
+  return op;
+}
+
+// Expand n bytes at src into the page dst.
+static void
+decompress(uchar *src, int n, uchar *dst)
+{
+  uchar *end = src + n;
+  int op, len, dist;
+
+  op = 0;
+  while(src < end){
+    if(*src < 0x80){
+      len = *src++ + 1;
+      if(op + len > PGSIZE)
+        panic("zswap: bad literal");
+      memmove(dst + op, src, len);
+      src += len;
+      op += len;
+    } else {
+      len = (*src & 0x7f) + MINMATCH;
+      dist = src[1] | src[2] << 8;
+      src += 3;
+      if(dist == 0 || dist > op || op + len > PGSIZE)
+        panic("zswap: bad match");
+      // Byte by byte: the match may overlap its own output.
+      for(; len > 0; len--, op++)
+        dst[op] = dst[op - dist];
+    }
+  }
+  if(op != PGSIZE)
+    panic("zswap: short page");
+}
+
+// Pages of memory the pool holds.
+static int
+poolpages(void)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < NZCLASS; i++)
+    n += zswap.cache[i]->nslabs;
+  return n;
+}
+
+// Drop the entry of slot. Caller must hold zswap.lock.
+static void
+zdrop(uint slot)
+{
+  struct zentry *e = &zswap.ent[slot];
+
+  if(e->data == 0)
+    return;
+  kmem_cache_free(zswap.cache[e->cls], e->data);
+  e->data = 0;
+}
+
+// Keep a compressed copy of the page pg as the contents of slot.
+// Returns 0 if it is now in the pool, -1 if it must go to disk.
+int
+zswap_store(uint slot, char *pg)
+{
+  struct zentry *e;
+  int n, cls;
+  char *data;
+
+  if(slot >= SWAPSLOTS)
+    return -1;
+  acquire(&zswap.lock);
+  zdrop(slot);
+  if((n = compress((uchar*)pg, zswap.buf, ZMAXLEN)) < 0 ||
+     poolpages() >= ZSWAPPAGES){
+    release(&zswap.lock);
+    return -1;
+  }
+  for(cls = 0; (ZMINCLS << cls) < n; cls++)
+    ;
+  if((data = kmem_cache_alloc(zswap.cache[cls])) == 0){
+    release(&zswap.lock);
+    return -1;
+  }
+  memmove(data, zswap.buf, n);
+  e = &zswap.ent[slot];
+  e->data = data;
+  e->len = n;
+  e->cls = cls;
+  release(&zswap.lock);
+  return 0;
+}
+
+// Fill the page pg from the pool copy of slot.
+// Returns -1 if slot is not in the pool.
+int
+zswap_load(uint slot, char *pg)
+{
+  struct zentry *e;
+
+  if(slot >= SWAPSLOTS)
+    return -1;
+  acquire(&zswap.lock);
+  e = &zswap.ent[slot];
+  if(e->data == 0){
+    release(&zswap.lock);
+    return -1;
+  }
+  decompress((uchar*)e->data, e->len, (uchar*)pg);
+  release(&zswap.lock);
+  return 0;
+}
+
+// Slot is free: forget its pool copy, if any.
+void
+zswap_invalidate(uint slot)
+{
+  if(slot >= SWAPSLOTS)
+    return;
+  acquire(&zswap.lock);
+  zdrop(slot);
+  release(&zswap.lock);
+}